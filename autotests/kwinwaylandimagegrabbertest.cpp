@@ -0,0 +1,324 @@
+/*
+ *  Copyright (C) 2019 The Spectacle Developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "PlatformBackends/KWinWaylandImageGrabber.h"
+#include "SpectacleConfig.h"
+#include "Config.h"
+
+#include <QApplication>
+#include <QAtomicInt>
+#include <QDataStream>
+#include <QDBusConnection>
+#include <QDBusContext>
+#include <QDBusUnixFileDescriptor>
+#include <QElapsedTimer>
+#include <QPainter>
+#include <QProcess>
+#include <QSignalSpy>
+#include <QStandardPaths>
+#include <QTest>
+#include <QThread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+static const QString FAKE_CONNECTION = QStringLiteral("fake-kwin");
+
+// stands in for org.kde.kwin.Screenshot. it runs on a thread of its own,
+// so it keeps answering while the grabber blocks on a reply
+
+class FakeScreenshot : public QObject, protected QDBusContext
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.kde.kwin.Screenshot")
+
+    public:
+
+    enum Behaviour {
+        WriteImage,
+        RejectMemfd,      // memory files get an error reply, pipes the image
+        WriteIncomplete,  // only the first half of the data is written
+        KeepOpen          // nothing is written and the descriptor never closed
+    };
+
+    explicit FakeScreenshot(const QImage &image) :
+        QObject(),
+        mImage(image)
+    {}
+
+    QAtomicInt behaviour;
+    QAtomicInt calls;
+    QAtomicInt memfdCalls;
+
+    public Q_SLOTS:
+
+    void screenshotFullscreen(const QDBusUnixFileDescriptor &fd, bool captureCursor)
+    {
+        Q_UNUSED(captureCursor);
+        calls.ref();
+
+        // only memory files know about seals
+#ifdef F_GET_SEALS
+        const bool isMemfd = fcntl(fd.fileDescriptor(), F_GET_SEALS) >= 0;
+#else
+        const bool isMemfd = false;
+#endif
+        if (isMemfd) {
+            memfdCalls.ref();
+        }
+
+        if (behaviour.load() == RejectMemfd && isMemfd) {
+            sendErrorReply(QDBusError::NotSupported, QStringLiteral("Memory files are not supported"));
+            return;
+        }
+        if (behaviour.load() == KeepOpen) {
+            mHeld.append(fd);
+            return;
+        }
+
+        QByteArray data;
+        QDataStream stream(&data, QIODevice::WriteOnly);
+        stream << mImage;
+        if (behaviour.load() == WriteIncomplete) {
+            data.truncate(data.size() / 2);
+        }
+
+        const char *next = data.constData();
+        qint64 left = data.size();
+        while (left > 0) {
+            const ssize_t written = write(fd.fileDescriptor(), next, static_cast<size_t>(left));
+            if (written <= 0) {
+                break;
+            }
+            next += written;
+            left -= written;
+        }
+    }
+
+    void releaseHeld()
+    {
+        mHeld.clear();
+    }
+
+    private:
+
+    QImage                         mImage;
+    QList<QDBusUnixFileDescriptor> mHeld;
+};
+
+class FakeEffects : public QObject
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.kde.kwin.Effects")
+
+    public Q_SLOTS:
+
+    bool isEffectLoaded(const QString &name)
+    {
+        return name == QLatin1String("screenshot");
+    }
+};
+
+class KWinWaylandImageGrabberTest : public QObject
+{
+    Q_OBJECT
+
+    private Q_SLOTS:
+
+    void initTestCase();
+    void cleanupTestCase();
+    void init();
+    void cleanup();
+
+    void memfdSucceeds();
+    void memfdRejectedFallsBackToPipe();
+    void incompleteFileFails();
+    void timeoutFails();
+
+    private:
+
+    QImage                   mImage;
+    QThread                  mServiceThread;
+    FakeScreenshot          *mScreenshot = nullptr;
+    FakeEffects             *mEffects = nullptr;
+    KWinWaylandImageGrabber *mGrabber = nullptr;
+};
+
+void KWinWaylandImageGrabberTest::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+
+    // something with a bit of structure, so a wrong decode shows
+    mImage = QImage(64, 48, QImage::Format_ARGB32);
+    mImage.fill(Qt::white);
+    QPainter painter(&mImage);
+    painter.fillRect(8, 8, 24, 16, Qt::blue);
+    painter.fillRect(40, 20, 16, 20, QColor(255, 0, 0, 128));
+    painter.end();
+
+    QDBusConnection connection = QDBusConnection::connectToBus(QDBusConnection::SessionBus, FAKE_CONNECTION);
+    if (!connection.isConnected()) {
+        QSKIP("No session bus");
+    }
+    if (!connection.registerService(QStringLiteral("org.kde.KWin"))) {
+        QSKIP("org.kde.KWin is already taken on this bus");
+    }
+
+    mScreenshot = new FakeScreenshot(mImage);
+    mEffects = new FakeEffects;
+    mScreenshot->moveToThread(&mServiceThread);
+    mEffects->moveToThread(&mServiceThread);
+    mServiceThread.start();
+
+    QVERIFY(connection.registerObject(QStringLiteral("/Screenshot"), mScreenshot, QDBusConnection::ExportAllSlots));
+    QVERIFY(connection.registerObject(QStringLiteral("/Effects"), mEffects, QDBusConnection::ExportAllSlots));
+}
+
+void KWinWaylandImageGrabberTest::cleanupTestCase()
+{
+    QDBusConnection::disconnectFromBus(FAKE_CONNECTION);
+    mServiceThread.quit();
+    mServiceThread.wait();
+    delete mScreenshot;
+    delete mEffects;
+}
+
+void KWinWaylandImageGrabberTest::init()
+{
+    mScreenshot->behaviour = FakeScreenshot::WriteImage;
+    mScreenshot->calls = 0;
+    mScreenshot->memfdCalls = 0;
+    SpectacleConfig::instance()->setCompositorCaptureTimeout(10000);
+
+    mGrabber = new KWinWaylandImageGrabber;
+    mGrabber->setGrabMode(ImageGrabber::FullScreen);
+}
+
+void KWinWaylandImageGrabberTest::cleanup()
+{
+    delete mGrabber;
+    mGrabber = nullptr;
+    QMetaObject::invokeMethod(mScreenshot, "releaseHeld", Qt::BlockingQueuedConnection);
+}
+
+void KWinWaylandImageGrabberTest::memfdSucceeds()
+{
+#ifndef HAVE_MEMFD_CREATE
+    QSKIP("Memory files are not supported on this system");
+#endif
+
+    QSignalSpy imageSpy(mGrabber, &ImageGrabber::imageChanged);
+    QSignalSpy failedSpy(mGrabber, &ImageGrabber::imageGrabFailed);
+
+    mGrabber->doImageGrab();
+    QVERIFY(imageSpy.wait());
+
+    QCOMPARE(failedSpy.count(), 0);
+    QCOMPARE(mScreenshot->calls.load(), 1);
+    QCOMPARE(mScreenshot->memfdCalls.load(), 1);
+    QCOMPARE(imageSpy.at(0).at(0).value<QImage>().convertToFormat(QImage::Format_ARGB32), mImage);
+}
+
+void KWinWaylandImageGrabberTest::memfdRejectedFallsBackToPipe()
+{
+#ifndef HAVE_MEMFD_CREATE
+    QSKIP("Memory files are not supported on this system");
+#endif
+
+    mScreenshot->behaviour = FakeScreenshot::RejectMemfd;
+
+    QSignalSpy imageSpy(mGrabber, &ImageGrabber::imageChanged);
+    QSignalSpy failedSpy(mGrabber, &ImageGrabber::imageGrabFailed);
+
+    mGrabber->doImageGrab();
+    QVERIFY(imageSpy.wait());
+
+    QCOMPARE(failedSpy.count(), 0);
+    QCOMPARE(mScreenshot->calls.load(), 2);
+    QCOMPARE(mScreenshot->memfdCalls.load(), 1);
+    QCOMPARE(imageSpy.at(0).at(0).value<QImage>().convertToFormat(QImage::Format_ARGB32), mImage);
+
+    // once rejected, memory files aren't tried again
+
+    mScreenshot->behaviour = FakeScreenshot::WriteImage;
+    mGrabber->doImageGrab();
+    QVERIFY(imageSpy.wait());
+    QCOMPARE(mScreenshot->calls.load(), 3);
+    QCOMPARE(mScreenshot->memfdCalls.load(), 1);
+}
+
+void KWinWaylandImageGrabberTest::incompleteFileFails()
+{
+#ifndef HAVE_MEMFD_CREATE
+    QSKIP("Memory files are not supported on this system");
+#endif
+
+    mScreenshot->behaviour = FakeScreenshot::WriteIncomplete;
+
+    QSignalSpy imageSpy(mGrabber, &ImageGrabber::imageChanged);
+    QSignalSpy failedSpy(mGrabber, &ImageGrabber::imageGrabFailed);
+
+    mGrabber->doImageGrab();
+    QVERIFY(failedSpy.wait());
+
+    QCOMPARE(imageSpy.count(), 0);
+    QCOMPARE(mScreenshot->calls.load(), 1);
+}
+
+void KWinWaylandImageGrabberTest::timeoutFails()
+{
+    mScreenshot->behaviour = FakeScreenshot::KeepOpen;
+    SpectacleConfig::instance()->setCompositorCaptureTimeout(500);
+
+    QSignalSpy imageSpy(mGrabber, &ImageGrabber::imageChanged);
+    QSignalSpy failedSpy(mGrabber, &ImageGrabber::imageGrabFailed);
+
+    QElapsedTimer timer;
+    timer.start();
+    mGrabber->doImageGrab();
+    QVERIFY(failedSpy.wait(5000));
+
+    // timers may fire a little early
+    QVERIFY(timer.elapsed() >= 450);
+    QCOMPARE(imageSpy.count(), 0);
+}
+
+int main(int argc, char **argv)
+{
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+
+    // the fake KWin gets a bus of its own, so it can't get in the way of
+    // a real one. without dbus-daemon the session bus is used, if any
+
+    QProcess bus;
+    bus.start(QStringLiteral("dbus-daemon"), {QStringLiteral("--session"), QStringLiteral("--nofork"), QStringLiteral("--print-address")});
+    if (bus.waitForStarted() && bus.waitForReadyRead()) {
+        qputenv("DBUS_SESSION_BUS_ADDRESS", bus.readLine().trimmed());
+    }
+
+    KWinWaylandImageGrabberTest test;
+    const int result = QTest::qExec(&test, argc, argv);
+
+    bus.kill();
+    bus.waitForFinished();
+    return result;
+}
+
+#include "kwinwaylandimagegrabbertest.moc"
@@ -0,0 +1,118 @@
+/*
+ *  Copyright (C) 2019 The Spectacle Developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "Encoders/ParallelPngWriter.h"
+
+#include <QBuffer>
+#include <QImageReader>
+#include <QTest>
+
+// whatever ParallelPngWriter writes has to decode to the image it was
+// given. the images are small, but tall enough to span several bands, and
+// narrow ones reach the first pixel handling of the filters
+
+class ParallelPngWriterTest : public QObject
+{
+    Q_OBJECT
+
+    private Q_SLOTS:
+
+    void roundTrip_data();
+    void roundTrip();
+    void emptyImageFails();
+};
+
+// flat areas, gradients and noise, so that every filter gets picked somewhere
+static QImage testImage(int width, int height, QImage::Format format)
+{
+    QImage image(width, height, format);
+    quint32 seed = 1;
+    for (int y = 0; y < height; ++y) {
+        quint32 *line = reinterpret_cast<quint32 *>(image.scanLine(y));
+        for (int x = 0; x < width; ++x) {
+            seed = seed * 1103515245 + 12345;
+            quint32 color = 0xffeff0f1;
+            if (y % 5 == 0) {
+                color = seed;
+            } else if (x % 3 == 0) {
+                color = (x * 7 + y * 13) * 0x010203;
+            }
+            if (format == QImage::Format_RGB32) {
+                color |= 0xff000000;
+            }
+            line[x] = color;
+        }
+    }
+    return image;
+}
+
+void ParallelPngWriterTest::roundTrip_data()
+{
+    QTest::addColumn<int>("width");
+    QTest::addColumn<int>("height");
+    QTest::addColumn<bool>("hasAlpha");
+    QTest::addColumn<int>("level");
+
+    QTest::newRow("rgb, 1 wide") << 1 << 300 << false << 6;
+    QTest::newRow("rgb, 77 wide") << 77 << 300 << false << 6;
+    QTest::newRow("rgb, several bands") << 1000 << 1200 << false << 6;
+    QTest::newRow("rgb, stored") << 500 << 600 << false << 0;
+    QTest::newRow("rgb, best") << 500 << 600 << false << 9;
+    QTest::newRow("rgba, 2 wide") << 2 << 300 << true << 6;
+    QTest::newRow("rgba, several bands") << 1000 << 1200 << true << 6;
+}
+
+void ParallelPngWriterTest::roundTrip()
+{
+    QFETCH(int, width);
+    QFETCH(int, height);
+    QFETCH(bool, hasAlpha);
+    QFETCH(int, level);
+    const QImage image = testImage(width, height, hasAlpha ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    ParallelPngWriter writer(&buffer);
+    writer.setCompressionLevel(level);
+    QVERIFY2(writer.write(image), qPrintable(writer.errorString()));
+    buffer.close();
+
+    buffer.open(QIODevice::ReadOnly);
+    QImageReader reader(&buffer, "png");
+    const QImage decoded = reader.read();
+    QVERIFY2(!decoded.isNull(), qPrintable(reader.errorString()));
+    QCOMPARE(decoded.hasAlphaChannel(), hasAlpha);
+    QCOMPARE(decoded.convertToFormat(image.format()), image);
+}
+
+void ParallelPngWriterTest::emptyImageFails()
+{
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    ParallelPngWriter writer(&buffer);
+    QVERIFY(!writer.write(QImage()));
+    QVERIFY(!writer.errorString().isEmpty());
+    QVERIFY(data.isEmpty());
+}
+
+QTEST_GUILESS_MAIN(ParallelPngWriterTest)
+
+#include "parallelpngwritertest.moc"
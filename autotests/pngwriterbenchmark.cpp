@@ -0,0 +1,116 @@
+/*
+ *  Copyright (C) 2019 The Spectacle Developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "Encoders/ParallelPngWriter.h"
+
+#include <QBuffer>
+#include <QImageWriter>
+#include <QTest>
+
+// ParallelPngWriter against Qt's own PNG writer, on a 4K screenshot. both
+// write at zlib's default level. the time is what QBENCHMARK measures, the
+// size of the file is logged for every row. this is too slow to run with
+// the tests, it's built but only ever run by hand
+
+class PngWriterBenchmark : public QObject
+{
+    Q_OBJECT
+
+    private Q_SLOTS:
+
+    void initTestCase();
+
+    void write_data();
+    void write();
+
+    private:
+
+    QImage mDesktopImage;
+    QImage mPhotoImage;
+};
+
+// flat window areas with rows of text-like runs. the photo variant has a
+// noisy strip along the right edge, which the filters have a harder time
+// with
+
+static QImage screenImage(bool withPhoto)
+{
+    QImage image(3840, 2160, QImage::Format_RGB32);
+    for (int y = 0; y < image.height(); ++y) {
+        quint32 *line = reinterpret_cast<quint32 *>(image.scanLine(y));
+        for (int x = 0; x < image.width(); ++x) {
+            quint32 color = 0xffeff0f1;
+            if ((x / 200 + y / 150) % 3 == 0) {
+                color = 0xff3daee9;
+            }
+            if (y % 23 < 9 && x % 7 < 3 && x % 400 < 300) {
+                color = 0xff232629;
+            }
+            if (withPhoto && x > 3000) {
+                color = 0xff000000 | ((x * y) & 0xffffff);
+            }
+            line[x] = color;
+        }
+    }
+    return image;
+}
+
+void PngWriterBenchmark::initTestCase()
+{
+    mDesktopImage = screenImage(false);
+    mPhotoImage = screenImage(true);
+}
+
+void PngWriterBenchmark::write_data()
+{
+    QTest::addColumn<bool>("parallel");
+    QTest::addColumn<bool>("withPhoto");
+
+    QTest::newRow("ParallelPngWriter, desktop") << true << false;
+    QTest::newRow("QImageWriter, desktop") << false << false;
+    QTest::newRow("ParallelPngWriter, photo") << true << true;
+    QTest::newRow("QImageWriter, photo") << false << true;
+}
+
+void PngWriterBenchmark::write()
+{
+    QFETCH(bool, parallel);
+    QFETCH(bool, withPhoto);
+    const QImage &image = withPhoto ? mPhotoImage : mDesktopImage;
+
+    QByteArray data;
+    QBENCHMARK {
+        data.clear();
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::WriteOnly);
+        if (parallel) {
+            ParallelPngWriter writer(&buffer);
+            writer.setCompressionLevel(6);
+            QVERIFY(writer.write(image));
+        } else {
+            QImageWriter writer(&buffer, "png");
+            QVERIFY(writer.write(image));
+        }
+    }
+    qDebug() << QTest::currentDataTag() << "wrote" << data.size() << "bytes";
+}
+
+QTEST_GUILESS_MAIN(PngWriterBenchmark)
+
+#include "pngwriterbenchmark.moc"
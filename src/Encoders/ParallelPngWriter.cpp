@@ -0,0 +1,387 @@
+/*
+ *  Copyright (C) 2019 The Spectacle Developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "ParallelPngWriter.h"
+#include "PngChunks.h"
+#include "ImageProcessing/PixelKernels.h"
+
+#include <QColor>
+#include <QVector>
+#include <QtConcurrentMap>
+#include <QtEndian>
+
+#include <cstring>
+
+// every band holds about this much filtered data. every band starts a new
+// deflate block, and on flat screen content the block headers add up with
+// smaller bands. this still makes about 25 bands of a 4K screen, enough to
+// keep all cores busy
+static const int BAND_SIZE = 1024 * 1024;
+
+// deflate looks back at most this far, so that's all a band needs to see
+// of the band before it
+static const int DICTIONARY_SIZE = 32 * 1024;
+
+static const uchar PNG_FILTER_NONE    = 0;
+static const uchar PNG_FILTER_SUB     = 1;
+static const uchar PNG_FILTER_UP      = 2;
+static const uchar PNG_FILTER_AVERAGE = 3;
+static const uchar PNG_FILTER_PAETH   = 4;
+
+// helpers
+
+static void unpackRow(uchar *out, const quint32 *pixels, int width, bool hasAlpha)
+{
+    if (hasAlpha) {
+        for (int x = 0; x < width; ++x) {
+            const quint32 pixel = pixels[x];
+            *out++ = static_cast<uchar>(qRed(pixel));
+            *out++ = static_cast<uchar>(qGreen(pixel));
+            *out++ = static_cast<uchar>(qBlue(pixel));
+            *out++ = static_cast<uchar>(qAlpha(pixel));
+        }
+    } else {
+        for (int x = 0; x < width; ++x) {
+            const quint32 pixel = pixels[x];
+            *out++ = static_cast<uchar>(qRed(pixel));
+            *out++ = static_cast<uchar>(qGreen(pixel));
+            *out++ = static_cast<uchar>(qBlue(pixel));
+        }
+    }
+}
+
+// the filtered bytes are scored as signed values, so small differences in
+// either direction count as cheap
+static inline int filterCost(uchar value)
+{
+    return qAbs(static_cast<int>(static_cast<signed char>(value)));
+}
+
+// picks whichever of left, above and above left is closest to their
+// gradient, as defined by the PNG specification
+static inline uchar paethPredictor(uchar left, uchar above, uchar aboveLeft)
+{
+    const int estimate = left + above - aboveLeft;
+    const int leftDistance = qAbs(estimate - left);
+    const int aboveDistance = qAbs(estimate - above);
+    const int aboveLeftDistance = qAbs(estimate - aboveLeft);
+    if (leftDistance <= aboveDistance && leftDistance <= aboveLeftDistance) {
+        return left;
+    }
+    return (aboveDistance <= aboveLeftDistance) ? above : aboveLeft;
+}
+
+// the prediction of a filter for one byte. Sub, Up and Average are
+// written out where it matters, this is for the rest
+static inline uchar predict(uchar filter, uchar left, uchar above, uchar aboveLeft)
+{
+    switch (filter) {
+    case PNG_FILTER_SUB:
+        return left;
+    case PNG_FILTER_UP:
+        return above;
+    case PNG_FILTER_AVERAGE:
+        return static_cast<uchar>((left + above) >> 1);
+    case PNG_FILTER_PAETH:
+        return paethPredictor(left, above, aboveLeft);
+    default:
+        return 0;
+    }
+}
+
+// previousRow is all zeros for the first row of the image
+static uchar filterRow(uchar *out, const uchar *row, const uchar *previousRow, int length, int bytesPerPixel)
+{
+    // a row that repeats the one above it turns into nothing but zeros with
+    // Up. that's the most common case in screenshots, so check it first
+
+    if (memcmp(row, previousRow, length) == 0) {
+        memset(out, 0, length);
+        return PNG_FILTER_UP;
+    }
+
+    // the first pixel has nothing to its left, which the filters see as
+    // zeros. that's handled on its own, so the loop over the rest of the
+    // row doesn't need to check
+
+    int costs[5] = { 0, 0, 0, 0, 0 };
+    const int start = qMin(bytesPerPixel, length);
+    for (int i = 0; i < start; ++i) {
+        for (uchar filter = PNG_FILTER_NONE; filter <= PNG_FILTER_PAETH; ++filter) {
+            costs[filter] += filterCost(row[i] - predict(filter, 0, previousRow[i], 0));
+        }
+    }
+    for (int i = start; i < length; ++i) {
+        const uchar left = row[i - bytesPerPixel];
+        const uchar above = previousRow[i];
+        const uchar aboveLeft = previousRow[i - bytesPerPixel];
+        costs[PNG_FILTER_NONE] += filterCost(row[i]);
+        costs[PNG_FILTER_SUB] += filterCost(row[i] - left);
+        costs[PNG_FILTER_UP] += filterCost(row[i] - above);
+        costs[PNG_FILTER_AVERAGE] += filterCost(row[i] - ((left + above) >> 1));
+        costs[PNG_FILTER_PAETH] += filterCost(row[i] - paethPredictor(left, above, aboveLeft));
+    }
+
+    // on a tie the filter that's cheaper to undo wins, they're numbered
+    // in that order
+
+    uchar filter = PNG_FILTER_NONE;
+    for (uchar candidate = PNG_FILTER_SUB; candidate <= PNG_FILTER_PAETH; ++candidate) {
+        if (costs[candidate] < costs[filter]) {
+            filter = candidate;
+        }
+    }
+
+    for (int i = 0; i < start; ++i) {
+        out[i] = row[i] - predict(filter, 0, previousRow[i], 0);
+    }
+    switch (filter) {
+    case PNG_FILTER_NONE:
+        memcpy(out + start, row + start, length - start);
+        break;
+    case PNG_FILTER_SUB:
+        for (int i = start; i < length; ++i) {
+            out[i] = row[i] - row[i - bytesPerPixel];
+        }
+        break;
+    case PNG_FILTER_UP:
+        for (int i = start; i < length; ++i) {
+            out[i] = row[i] - previousRow[i];
+        }
+        break;
+    case PNG_FILTER_AVERAGE:
+        for (int i = start; i < length; ++i) {
+            out[i] = row[i] - ((row[i - bytesPerPixel] + previousRow[i]) >> 1);
+        }
+        break;
+    default:
+        for (int i = start; i < length; ++i) {
+            out[i] = row[i] - paethPredictor(row[i - bytesPerPixel], previousRow[i], previousRow[i - bytesPerPixel]);
+        }
+        break;
+    }
+    return filter;
+}
+
+// ParallelPngWriter
+
+ParallelPngWriter::ParallelPngWriter(QIODevice *device) :
+    mDevice(device),
+    mCompressionLevel(6)
+{}
+
+void ParallelPngWriter::setCompressionLevel(int level)
+{
+    mCompressionLevel = qBound(0, level, 9);
+}
+
+int ParallelPngWriter::compressionLevel() const
+{
+    return mCompressionLevel;
+}
+
+QString ParallelPngWriter::errorString() const
+{
+    return mErrorString;
+}
+
+bool ParallelPngWriter::fail(const QString &errorString)
+{
+    mErrorString = errorString;
+    return false;
+}
+
+bool ParallelPngWriter::write(const QImage &image)
+{
+    if (image.isNull()) {
+        return fail(QStringLiteral("Cannot write an empty image"));
+    }
+    if (!mDevice->isWritable()) {
+        return fail(QStringLiteral("Device not writable"));
+    }
+
+    const bool hasAlpha = image.hasAlphaChannel();
+    QImage pixels = image;
+    if (hasAlpha) {
+        if (pixels.format() != QImage::Format_ARGB32 && pixels.format() != QImage::Format_ARGB32_Premultiplied) {
+            pixels = pixels.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        }
+    } else if (pixels.format() != QImage::Format_RGB32) {
+        pixels = pixels.convertToFormat(QImage::Format_RGB32);
+    }
+    const bool isPremultiplied = (pixels.format() == QImage::Format_ARGB32_Premultiplied);
+
+    const int width = pixels.width();
+    const int height = pixels.height();
+    const int bytesPerPixel = hasAlpha ? 4 : 3;
+    const int rowLength = width * bytesPerPixel;
+    const int rowsPerBand = qMax(1, BAND_SIZE / (rowLength + 1));
+
+    QVector<Band> bands;
+    bands.reserve((height + rowsPerBand - 1) / rowsPerBand);
+    for (int firstRow = 0; firstRow < height; firstRow += rowsPerBand) {
+        Band band;
+        band.firstRow = firstRow;
+        band.rowCount = qMin(rowsPerBand, height - firstRow);
+        band.adler = 0;
+        band.ok = false;
+        bands.append(band);
+    }
+
+    // filtering only needs the image itself, so all bands are filtered
+    // first. compressing a band needs the filtered tail of the band before
+    // it as the dictionary
+
+    QtConcurrent::blockingMap(bands, [=, &pixels](Band &band) {
+        band.filtered.resize(band.rowCount * (rowLength + 1));
+        uchar *out = reinterpret_cast<uchar *>(band.filtered.data());
+
+        QVector<quint32> pixelBuffer(isPremultiplied ? width : 0);
+        QByteArray currentRow(rowLength, 0);
+        QByteArray previousRow(rowLength, 0);
+
+        auto unpack = [&](int y, QByteArray &row) {
+            const quint32 *source = reinterpret_cast<const quint32 *>(pixels.constScanLine(y));
+            if (isPremultiplied) {
+                PixelKernels::unpremultiply(pixelBuffer.data(), source, width);
+                source = pixelBuffer.constData();
+            }
+            unpackRow(reinterpret_cast<uchar *>(row.data()), source, width, hasAlpha);
+        };
+
+        if (band.firstRow > 0) {
+            unpack(band.firstRow - 1, previousRow);
+        }
+
+        for (int y = band.firstRow; y < band.firstRow + band.rowCount; ++y) {
+            unpack(y, currentRow);
+            out[0] = filterRow(out + 1, reinterpret_cast<const uchar *>(currentRow.constData()),
+                               reinterpret_cast<const uchar *>(previousRow.constData()), rowLength, bytesPerPixel);
+            out += rowLength + 1;
+            qSwap(currentRow, previousRow);
+        }
+    });
+
+    const Band *firstBand = bands.constData();
+    const Band *lastBand = firstBand + bands.size() - 1;
+    const int level = mCompressionLevel;
+
+    QtConcurrent::blockingMap(bands, [=](Band &band) {
+        const Band *previous = (&band == firstBand) ? nullptr : &band - 1;
+        const bool isLast = (&band == lastBand);
+
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        if (deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return;
+        }
+
+        if (previous) {
+            const int dictionaryLength = qMin(DICTIONARY_SIZE, previous->filtered.size());
+            const char *dictionary = previous->filtered.constData() + previous->filtered.size() - dictionaryLength;
+            deflateSetDictionary(&stream, reinterpret_cast<const Bytef *>(dictionary), static_cast<uInt>(dictionaryLength));
+        }
+
+        stream.next_in = reinterpret_cast<Bytef *>(band.filtered.data());
+        stream.avail_in = static_cast<uInt>(band.filtered.size());
+
+        // deflateBound() is only exact for a single Z_FINISH, a sync flush
+        // may need a few bytes more
+        band.compressed.resize(static_cast<int>(deflateBound(&stream, stream.avail_in)) + 16);
+        int outFill = 0;
+
+        const int flush = isLast ? Z_FINISH : Z_SYNC_FLUSH;
+        for (;;) {
+            stream.next_out = reinterpret_cast<Bytef *>(band.compressed.data()) + outFill;
+            stream.avail_out = static_cast<uInt>(band.compressed.size() - outFill);
+
+            const int result = deflate(&stream, flush);
+            if (result == Z_STREAM_ERROR) {
+                deflateEnd(&stream);
+                return;
+            }
+            outFill = band.compressed.size() - static_cast<int>(stream.avail_out);
+
+            if (stream.avail_out == 0) {
+                band.compressed.resize(band.compressed.size() * 2);
+                continue;
+            }
+            if (flush != Z_FINISH || result == Z_STREAM_END) {
+                break;
+            }
+        }
+        deflateEnd(&stream);
+        band.compressed.resize(outFill);
+
+        band.adler = adler32(adler32(0L, Z_NULL, 0), reinterpret_cast<const Bytef *>(band.filtered.constData()),
+                             static_cast<uInt>(band.filtered.size()));
+        band.ok = true;
+    });
+
+    // stitch the bands together into a single zlib stream: the header goes
+    // in front of the first band and the checksum of the whole image behind
+    // the last one
+
+    uLong adler = 0;
+    for (int i = 0; i < bands.size(); ++i) {
+        if (!bands.at(i).ok) {
+            return fail(QStringLiteral("Compression failed"));
+        }
+        adler = (i == 0) ? bands.at(i).adler
+                         : adler32_combine(adler, bands.at(i).adler, static_cast<z_off_t>(bands.at(i).filtered.size()));
+    }
+
+    char zlibHeader[2];
+    zlibHeader[0] = '\x78';
+    if (mCompressionLevel < 2) {
+        zlibHeader[1] = '\x01';
+    } else if (mCompressionLevel < 6) {
+        zlibHeader[1] = '\x5e';
+    } else if (mCompressionLevel == 6) {
+        zlibHeader[1] = '\x9c';
+    } else {
+        zlibHeader[1] = '\xda';
+    }
+    bands.first().compressed.prepend(zlibHeader, sizeof(zlibHeader));
+
+    char adlerField[4];
+    qToBigEndian<quint32>(static_cast<quint32>(adler), reinterpret_cast<uchar *>(adlerField));
+    bands.last().compressed.append(adlerField, sizeof(adlerField));
+
+    // write the file
+
+    if (!PngChunks::writeHeader(mDevice, pixels.size(), hasAlpha)) {
+        return fail(mDevice->errorString());
+    }
+
+    for (const Band &band : bands) {
+        if (!writeChunk("IDAT", band.compressed.constData(), band.compressed.size())) {
+            return false;
+        }
+    }
+    return writeChunk("IEND", nullptr, 0);
+}
+
+bool ParallelPngWriter::writeChunk(const char *type, const char *data, int length)
+{
+    if (!PngChunks::writeChunk(mDevice, type, data, length)) {
+        return fail(mDevice->errorString());
+    }
+    return true;
+}
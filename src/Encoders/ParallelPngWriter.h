@@ -0,0 +1,81 @@
+/*
+ *  Copyright (C) 2019 The Spectacle Developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#ifndef PARALLELPNGWRITER_H
+#define PARALLELPNGWRITER_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QIODevice>
+#include <QString>
+
+#include <zlib.h>
+
+// Writes a complete image as a PNG file, using all cores.
+//
+// The image is split into bands of rows that are filtered and deflated
+// independently on the global thread pool, in the same way pigz does it.
+// Every band but the last ends on a sync flush, which leaves the compressed
+// data on a byte boundary, so the bands can simply be concatenated into a
+// single zlib stream. Each band is primed with the last 32K of the band
+// before it, which keeps the size close to what a single stream produces.
+//
+// The filter of every row is picked for screen content: rows that repeat
+// the row above use Up without looking any further, which takes care of
+// most of a screenshot. Every other row gets the filter with the smallest
+// sum of absolute values out of all five, like libpng does.
+//
+// Images without an alpha channel are written as 8-bit RGB, all others as
+// 8-bit RGBA.
+
+class ParallelPngWriter
+{
+    public:
+
+    explicit ParallelPngWriter(QIODevice *device);
+
+    // zlib compression level, from 0 to 9
+    void setCompressionLevel(int level);
+    int compressionLevel() const;
+
+    bool write(const QImage &image);
+
+    QString errorString() const;
+
+    private:
+
+    struct Band
+    {
+        int        firstRow;
+        int        rowCount;
+        QByteArray filtered;
+        QByteArray compressed;
+        uLong      adler;
+        bool       ok;
+    };
+
+    bool writeChunk(const char *type, const char *data, int length);
+    bool fail(const QString &errorString);
+
+    QIODevice *mDevice;
+    int        mCompressionLevel;
+    QString    mErrorString;
+};
+
+#endif // PARALLELPNGWRITER_H
@@ -0,0 +1,63 @@
+/*
+ *  Copyright (C) 2019 The Spectacle Developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "PngChunks.h"
+
+#include <QtEndian>
+
+#include <zlib.h>
+
+static const char PNG_SIGNATURE[] = { '\x89', 'P', 'N', 'G', '\r', '\n', '\x1a', '\n' };
+
+bool PngChunks::writeHeader(QIODevice *device, const QSize &size, bool hasAlpha)
+{
+    if (device->write(PNG_SIGNATURE, sizeof(PNG_SIGNATURE)) != sizeof(PNG_SIGNATURE)) {
+        return false;
+    }
+
+    char header[13];
+    qToBigEndian<quint32>(size.width(), reinterpret_cast<uchar *>(header));
+    qToBigEndian<quint32>(size.height(), reinterpret_cast<uchar *>(header + 4));
+    header[8] = 8;                  // bit depth
+    header[9] = hasAlpha ? 6 : 2;   // color type, RGBA or RGB
+    header[10] = 0;                 // compression method
+    header[11] = 0;                 // filter method
+    header[12] = 0;                 // no interlacing
+    return writeChunk(device, "IHDR", header, sizeof(header));
+}
+
+bool PngChunks::writeChunk(QIODevice *device, const char *type, const char *data, int length)
+{
+    uchar lengthField[4];
+    qToBigEndian<quint32>(length, lengthField);
+
+    // the CRC covers the chunk type and the data, but not the length
+
+    uLong crc = crc32(0L, reinterpret_cast<const Bytef *>(type), 4);
+    if (length > 0) {
+        crc = crc32(crc, reinterpret_cast<const Bytef *>(data), static_cast<uInt>(length));
+    }
+    uchar crcField[4];
+    qToBigEndian<quint32>(static_cast<quint32>(crc), crcField);
+
+    return device->write(reinterpret_cast<const char *>(lengthField), 4) == 4
+        && device->write(type, 4) == 4
+        && (length == 0 || device->write(data, length) == length)
+        && device->write(reinterpret_cast<const char *>(crcField), 4) == 4;
+}
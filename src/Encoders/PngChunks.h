@@ -0,0 +1,39 @@
+/*
+ *  Copyright (C) 2019 The Spectacle Developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#ifndef PNGCHUNKS_H
+#define PNGCHUNKS_H
+
+#include <QIODevice>
+#include <QSize>
+
+// The parts of a PNG file that every PNG writer needs. The functions
+// return false if the device failed, its errorString() says why.
+
+namespace PngChunks
+{
+    // the signature followed by the IHDR chunk of an 8-bit RGB or, with
+    // alpha, 8-bit RGBA image
+    bool writeHeader(QIODevice *device, const QSize &size, bool hasAlpha);
+
+    // a chunk with its length and CRC
+    bool writeChunk(QIODevice *device, const char *type, const char *data, int length);
+}
+
+#endif // PNGCHUNKS_H
@@ -0,0 +1,252 @@
+/*
+ *  Copyright (C) 2019 The Spectacle Developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "PngStreamWriter.h"
+#include "PngChunks.h"
+#include "ImageProcessing/PixelKernels.h"
+
+#include <QColor>
+
+#include <cstring>
+
+// compressed data is written out in IDAT chunks of (at most) this size
+
+static const int IDAT_CHUNK_SIZE = 256 * 1024;
+
+// every row is prefixed with the filter type. the Sub filter only looks at
+// the pixel to the left, which keeps rows independent of each other and is
+// very effective on the large flat areas screenshots usually have
+
+static const uchar PNG_FILTER_SUB = 1;
+
+PngStreamWriter::PngStreamWriter(QIODevice *device) :
+    mDevice(device),
+    mStreamActive(false),
+    mCompressionLevel(Z_DEFAULT_COMPRESSION),
+    mHasAlpha(false),
+    mRowsWritten(0),
+    mOutFill(0)
+{
+    memset(&mStream, 0, sizeof(mStream));
+}
+
+PngStreamWriter::~PngStreamWriter()
+{
+    if (mStreamActive) {
+        deflateEnd(&mStream);
+    }
+}
+
+void PngStreamWriter::setCompressionLevel(int level)
+{
+    mCompressionLevel = qBound(0, level, 9);
+}
+
+int PngStreamWriter::compressionLevel() const
+{
+    return mCompressionLevel;
+}
+
+QString PngStreamWriter::errorString() const
+{
+    return mErrorString;
+}
+
+bool PngStreamWriter::fail(const QString &errorString)
+{
+    mErrorString = errorString;
+    return false;
+}
+
+// ImageStreamSink implementation
+
+bool PngStreamWriter::beginImage(const QSize &size)
+{
+    if (size.isEmpty()) {
+        return fail(QStringLiteral("Cannot write an empty image"));
+    }
+    if (!mDevice->isWritable()) {
+        return fail(QStringLiteral("Device not writable"));
+    }
+
+    if (deflateInit(&mStream, mCompressionLevel) != Z_OK) {
+        return fail(QStringLiteral("Failed to initialize the compressor"));
+    }
+    mStreamActive = true;
+
+    mSize = size;
+    mRowsWritten = 0;
+    mOutBuffer.resize(IDAT_CHUNK_SIZE);
+    mOutFill = 0;
+    return true;
+}
+
+bool PngStreamWriter::writeBand(const QImage &band)
+{
+    if (!mStreamActive) {
+        return fail(QStringLiteral("The image was not started"));
+    }
+    if (band.width() != mSize.width() || mRowsWritten + band.height() > mSize.height()) {
+        return fail(QStringLiteral("Image band doesn't fit into the image"));
+    }
+
+    // the color type is only known once the first band arrives. everything
+    // coming after that is converted to match
+
+    if (mRowsWritten == 0) {
+        if (!writeHeader(band.hasAlphaChannel())) {
+            return false;
+        }
+    }
+
+    QImage pixels = band;
+    if (mHasAlpha) {
+        if (pixels.format() != QImage::Format_ARGB32 && pixels.format() != QImage::Format_ARGB32_Premultiplied) {
+            pixels = pixels.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        }
+    } else if (pixels.format() != QImage::Format_RGB32) {
+        pixels = pixels.convertToFormat(QImage::Format_RGB32);
+    }
+    const bool isPremultiplied = (pixels.format() == QImage::Format_ARGB32_Premultiplied);
+
+    for (int y = 0; y < pixels.height(); ++y) {
+        const quint32 *row = reinterpret_cast<const quint32 *>(pixels.constScanLine(y));
+        if (isPremultiplied) {
+            PixelKernels::unpremultiply(mPixelBuffer.data(), row, mSize.width());
+            row = mPixelBuffer.constData();
+        }
+
+        filterRow(row);
+        if (!compress(reinterpret_cast<const uchar *>(mRowBuffer.constData()), mRowBuffer.size(), Z_NO_FLUSH)) {
+            return false;
+        }
+    }
+
+    mRowsWritten += pixels.height();
+    return true;
+}
+
+bool PngStreamWriter::finishImage()
+{
+    if (!mStreamActive) {
+        return fail(QStringLiteral("The image was not started"));
+    }
+    if (mRowsWritten != mSize.height()) {
+        return fail(QStringLiteral("The image is incomplete"));
+    }
+
+    if (!compress(nullptr, 0, Z_FINISH)) {
+        return false;
+    }
+    deflateEnd(&mStream);
+    mStreamActive = false;
+
+    return writeChunk("IEND", nullptr, 0);
+}
+
+// helpers
+
+bool PngStreamWriter::writeHeader(bool hasAlpha)
+{
+    mHasAlpha = hasAlpha;
+
+    const int bytesPerPixel = mHasAlpha ? 4 : 3;
+    mRowBuffer.resize(1 + mSize.width() * bytesPerPixel);
+    mRowBuffer[0] = static_cast<char>(PNG_FILTER_SUB);
+    if (mHasAlpha) {
+        mPixelBuffer.resize(mSize.width());
+    }
+
+    if (!PngChunks::writeHeader(mDevice, mSize, mHasAlpha)) {
+        return fail(mDevice->errorString());
+    }
+    return true;
+}
+
+void PngStreamWriter::filterRow(const quint32 *pixels)
+{
+    uchar *out = reinterpret_cast<uchar *>(mRowBuffer.data()) + 1;
+    quint32 left = 0;
+
+    if (mHasAlpha) {
+        for (int x = 0; x < mSize.width(); ++x) {
+            const quint32 pixel = pixels[x];
+            *out++ = static_cast<uchar>(qRed(pixel) - qRed(left));
+            *out++ = static_cast<uchar>(qGreen(pixel) - qGreen(left));
+            *out++ = static_cast<uchar>(qBlue(pixel) - qBlue(left));
+            *out++ = static_cast<uchar>(qAlpha(pixel) - qAlpha(left));
+            left = pixel;
+        }
+    } else {
+        for (int x = 0; x < mSize.width(); ++x) {
+            const quint32 pixel = pixels[x];
+            *out++ = static_cast<uchar>(qRed(pixel) - qRed(left));
+            *out++ = static_cast<uchar>(qGreen(pixel) - qGreen(left));
+            *out++ = static_cast<uchar>(qBlue(pixel) - qBlue(left));
+            left = pixel;
+        }
+    }
+}
+
+bool PngStreamWriter::compress(const uchar *data, int length, int flush)
+{
+    mStream.next_in = const_cast<Bytef *>(data);
+    mStream.avail_in = static_cast<uInt>(length);
+
+    for (;;) {
+        mStream.next_out = reinterpret_cast<Bytef *>(mOutBuffer.data()) + mOutFill;
+        mStream.avail_out = static_cast<uInt>(mOutBuffer.size() - mOutFill);
+
+        const int result = deflate(&mStream, flush);
+        if (result == Z_STREAM_ERROR) {
+            return fail(QStringLiteral("Compression failed"));
+        }
+        mOutFill = mOutBuffer.size() - static_cast<int>(mStream.avail_out);
+
+        // a full buffer means deflate may have more output pending
+
+        if (mOutFill == mOutBuffer.size()) {
+            if (!writeChunk("IDAT", mOutBuffer.constData(), mOutFill)) {
+                return false;
+            }
+            mOutFill = 0;
+            continue;
+        }
+
+        if (flush != Z_FINISH || result == Z_STREAM_END) {
+            break;
+        }
+    }
+
+    if (flush == Z_FINISH && mOutFill > 0) {
+        if (!writeChunk("IDAT", mOutBuffer.constData(), mOutFill)) {
+            return false;
+        }
+        mOutFill = 0;
+    }
+    return true;
+}
+
+bool PngStreamWriter::writeChunk(const char *type, const char *data, int length)
+{
+    if (!PngChunks::writeChunk(mDevice, type, data, length)) {
+        return fail(mDevice->errorString());
+    }
+    return true;
+}
@@ -0,0 +1,81 @@
+/*
+ *  Copyright (C) 2019 The Spectacle Developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#ifndef PNGSTREAMWRITER_H
+#define PNGSTREAMWRITER_H
+
+#include <QByteArray>
+#include <QIODevice>
+#include <QString>
+#include <QVector>
+
+#include <zlib.h>
+
+#include "PlatformBackends/ImageStreamSink.h"
+
+// Writes a PNG file row by row, as the bands of the image come in. The
+// compressed data is written to the device in IDAT chunks as soon as
+// deflate produces it, so only a single row of the image is buffered.
+//
+// Images without an alpha channel are written as 8-bit RGB, all others as
+// 8-bit RGBA.
+
+class PngStreamWriter : public ImageStreamSink
+{
+    public:
+
+    explicit PngStreamWriter(QIODevice *device);
+    ~PngStreamWriter() override;
+
+    PngStreamWriter(PngStreamWriter const&) = delete;
+    void operator= (PngStreamWriter const&) = delete;
+
+    bool beginImage(const QSize &size) override;
+    bool writeBand(const QImage &band) override;
+    bool finishImage() override;
+
+    // zlib compression level, from 0 to 9. must be set before the image starts
+    void setCompressionLevel(int level);
+    int compressionLevel() const;
+
+    QString errorString() const;
+
+    private:
+
+    bool writeHeader(bool hasAlpha);
+    void filterRow(const quint32 *pixels);
+    bool compress(const uchar *data, int length, int flush);
+    bool writeChunk(const char *type, const char *data, int length);
+    bool fail(const QString &errorString);
+
+    QIODevice        *mDevice;
+    z_stream          mStream;
+    bool              mStreamActive;
+    int               mCompressionLevel;
+    QSize             mSize;
+    bool              mHasAlpha;
+    int               mRowsWritten;
+    QByteArray        mRowBuffer;
+    QVector<quint32>  mPixelBuffer;
+    QByteArray        mOutBuffer;
+    int               mOutFill;
+    QString           mErrorString;
+};
+
+#endif // PNGSTREAMWRITER_H
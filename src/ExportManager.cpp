@@ -20,6 +20,7 @@
 #include "ExportManager.h"
 
 #include <QDir>
+#include <QFileInfo>
 #include <QMimeDatabase>
 #include <QImageWriter>
 #include <QTemporaryDir>
@@ -31,6 +32,11 @@
 #include <QBuffer>
 #include <QRegularExpression>
 #include <QRegularExpressionMatch>
+#include <QSaveFile>
+#include <QSharedPointer>
+#include <QSet>
+#include <QFutureWatcher>
+#include <QtConcurrentRun>
 
 #include <KLocalizedString>
 #include <KSharedConfig>
@@ -41,12 +47,56 @@
 #include <KIO/StatJob>
 
 #include "SpectacleConfig.h"
+#include "Encoders/ParallelPngWriter.h"
+#include "Encoders/PngStreamWriter.h"
+
+// saves that are reported as one once the last of them is done, like the
+// window images of an AllWindows grab
+
+struct ExportManager::SaveGroup
+{
+    QUrl url;
+    bool notify;
+    int  remaining;
+    int  savedCount;
+    int  failedCount;
+};
+
+// a save in progress. the image is encoded and written on the save pool,
+// everything else happens on the GUI thread
+
+struct ExportManager::SaveRequest
+{
+    QUrl       url;
+    QString    filePath;    // the file the pool writes, a temporary one for remote urls
+    QByteArray format;
+    QImage     image;
+    EncodingSettings encoding;
+    qint64     imageKey;     // the screenshot that was saved
+    QString    encodedKey;   // where the encoded bytes go in the cache, if anywhere
+    QByteArray encoded;      // the file contents, from the cache or from the pool
+    SaveKind   kind;
+    bool       notify;
+    QAtomicInt cancelled;
+    bool       written;
+    bool       finished;
+    bool       success;
+    QString    errorString;  // what went wrong on the pool, later the complete message
+
+    QSharedPointer<SaveGroup> group;
+    QFutureWatcher<void> *watcher;
+    KJob                 *job;
+};
 
 ExportManager::ExportManager(QObject *parent) :
     QObject(parent),
-    mSavePixmap(QPixmap()),
+    mSaveImage(QImage()),
     mTempFile(QUrl()),
-    mTempDir(nullptr)
+    mTempDir(nullptr),
+    mEncodingProfile(EncodingProfile::Archival),
+    mEncodingProfileSet(false),
+    mSaveBatchFinished(0),
+    mSaveBatchTotal(0)
 {
     connect(this, &ExportManager::imageSaved, [this](const QUrl &savedAt) {
         SpectacleConfig::instance()->setLastSaveFile(savedAt);
@@ -55,6 +105,9 @@ ExportManager::ExportManager(QObject *parent) :
 
 ExportManager::~ExportManager()
 {
+    // whatever is still being written is finished, but nobody is told anymore
+    mSavePool.waitForDone();
+    qDeleteAll(mPendingSaves);
     delete mTempDir;
 }
 
@@ -64,11 +117,11 @@ ExportManager* ExportManager::instance()
     return &instance;
 }
 
-// screenshot pixmap setter and getter
+// screenshot image setter and getter
 
-QPixmap ExportManager::pixmap() const
+QImage ExportManager::image() const
 {
-    return mSavePixmap;
+    return mSaveImage;
 }
 
 void ExportManager::setWindowTitle(const QString &windowTitle)
@@ -91,9 +144,21 @@ void ExportManager::setGrabMode(const ImageGrabber::GrabMode &grabMode)
     mGrabMode = grabMode;
 }
 
-void ExportManager::setPixmap(const QPixmap &pixmap)
+EncodingProfile ExportManager::encodingProfile() const
 {
-    mSavePixmap = pixmap;
+    return mEncodingProfileSet ? mEncodingProfile : SpectacleConfig::instance()->saveEncodingProfile();
+}
+
+void ExportManager::setEncodingProfile(EncodingProfile profile)
+{
+    mEncodingProfile = profile;
+    mEncodingProfileSet = true;
+}
+
+void ExportManager::setImage(const QImage &image)
+{
+    mSaveImage = image;
+    mEncodedImages.clear();
 
     // reset our saved tempfile
     if (mTempFile.isValid()) {
@@ -104,9 +169,9 @@ void ExportManager::setPixmap(const QPixmap &pixmap)
     }
 }
 
-void ExportManager::updatePixmapTimestamp()
+void ExportManager::updateImageTimestamp()
 {
-	mPixmapTimestamp = QDateTime::currentDateTime();
+	mImageTimestamp = QDateTime::currentDateTime();
 }
 
 // native file save helpers
@@ -158,7 +223,7 @@ QString ExportManager::truncatedFilename(QString const &filename)
 
 QString ExportManager::makeAutosaveFilename()
 {
-    const QDateTime timestamp = mPixmapTimestamp;
+    const QDateTime timestamp = mImageTimestamp;
     QString baseName = SpectacleConfig::instance()->autoSaveFilenameFormat();
     const QString baseDir = defaultSaveLocation();
     QString title;
@@ -243,6 +308,16 @@ QString ExportManager::makeAutosaveFilename()
     return truncatedFilename(result);
 }
 
+QString ExportManager::makeAutosaveDirectory()
+{
+    const QString baseName = QDir(defaultSaveLocation()).filePath(truncatedFilename(makeAutosaveFilename()));
+    QString result = baseName;
+    for (quint64 i = 1; QFileInfo::exists(result); i++) {
+        result = baseName + QStringLiteral("-%1").arg(i);
+    }
+    return result;
+}
+
 QString ExportManager::autoIncrementFilename(const QString &baseName, const QString &extension,
                                              FileNameAlreadyUsedCheck isFileNameUsed)
 {
@@ -277,82 +352,389 @@ QString ExportManager::makeSaveMimetype(const QUrl &url)
     return type;
 }
 
-bool ExportManager::writeImage(QIODevice *device, const QByteArray &format)
+// the save pipeline. images are encoded and written on a thread pool, so
+// saving doesn't block the GUI. a save is only reported as done, in the
+// order the saves were started, once the file is on disk or uploaded
+
+ExportManager::SaveRequest *ExportManager::save(const QUrl &url, const QString &mimetype, SaveKind kind, bool notify)
 {
-    QImageWriter imageWriter(device, format);
-    if (!(imageWriter.canWrite())) {
-        emit errorMessage(i18n("QImageWriter cannot write image: %1", imageWriter.errorString()));
-        return false;
+    SaveRequest *request = newSaveRequest(url, mimetype, kind, notify);
+    if (!request) {
+        return nullptr;
+    }
+
+    // the same screenshot is often saved several times in the same format,
+    // for drag and drop, for sharing and to disk. it's only encoded once,
+    // every save after that just writes the bytes
+
+    const EncodingProfile profile = (kind == SaveKind::Temporary) ? SpectacleConfig::instance()->tempEncodingProfile()
+                                                                  : encodingProfile();
+    request->imageKey = mSaveImage.cacheKey();
+    request->encodedKey = encodedImageKey(request->format, profile);
+    request->encoded = mEncodedImages.value(request->encodedKey);
+    if (request->encoded.isEmpty()) {
+        request->image = mSaveImage;
+        request->encoding = SpectacleConfig::instance()->encodingSettings(profile);
     }
 
-    return imageWriter.write(mSavePixmap.toImage());
+    startSave(request);
+    return request;
 }
 
-bool ExportManager::localSave(const QUrl &url, const QString &mimetype)
+// a request for anything but the current screenshot, which the caller
+// fills in with either the image or the encoded bytes before starting it
+
+ExportManager::SaveRequest *ExportManager::newSaveRequest(const QUrl &url, const QString &mimetype, SaveKind kind, bool notify)
 {
-    // Create save directory if it doesn't exist
-    const QUrl dirPath(url.adjusted(QUrl::RemoveFilename));
-    const QDir dir(dirPath.path());
+    if (!(url.isValid())) {
+        emit errorMessage(i18n("Cannot save screenshot. The save filename is invalid."));
+        return nullptr;
+    }
 
-    if (!dir.mkpath(QStringLiteral("."))) {
-        emit errorMessage(xi18nc("@info",
-                                 "Cannot save screenshot because creating "
-                                 "the directory failed:<nl/><filename>%1</filename>",
-                                 dirPath.path()));
-        return false;
+    SaveRequest *request = new SaveRequest;
+    request->url = url;
+    request->format = mimetype.toLatin1();
+    request->imageKey = 0;
+    request->kind = kind;
+    request->notify = notify;
+    request->written = false;
+    request->finished = false;
+    request->success = false;
+    request->job = nullptr;
+
+    if (url.isLocalFile()) {
+        request->filePath = url.toLocalFile();
+    } else {
+        QTemporaryFile tmpFile;
+        tmpFile.setAutoRemove(false);
+        if (!tmpFile.open()) {
+            emit errorMessage(i18n("Cannot save screenshot. Error while writing temporary local file."));
+            delete request;
+            return nullptr;
+        }
+        request->filePath = tmpFile.fileName();
+    }
+    return request;
+}
+
+void ExportManager::startSave(SaveRequest *request)
+{
+    mPendingSaves.append(request);
+    mSaveBatchTotal++;
+    emit saveProgress(mSaveBatchFinished, mSaveBatchTotal);
+
+    request->watcher = new QFutureWatcher<void>(this);
+    connect(request->watcher, &QFutureWatcher<void>::finished, this, [this, request] {
+        imageFileWritten(request);
+    });
+    request->watcher->setFuture(QtConcurrent::run(&mSavePool, &ExportManager::writeImageFile, request));
+}
+
+// PNG, the default format, goes through our own encoder which spreads the
+// work over all cores. everything else is left to the Qt image plugins
+
+bool ExportManager::writeImage(QIODevice *device, const QImage &image, const QByteArray &format,
+                               const EncodingSettings &settings, QString *errorString)
+{
+    if (format.toLower() == "png") {
+        ParallelPngWriter pngWriter(device);
+        pngWriter.setCompressionLevel(settings.compression);
+        if (!pngWriter.write(image)) {
+            *errorString = pngWriter.errorString();
+            return false;
+        }
+        return true;
     }
 
-    QFile outputFile(url.toLocalFile());
+    // plugins ignore the options they don't support. chroma subsampling
+    // can't be controlled through QImageWriter at all
 
-    outputFile.open(QFile::WriteOnly);
-    if(!writeImage(&outputFile, mimetype.toLatin1())) {
-        emit errorMessage(i18n("Cannot save screenshot. Error while writing file."));
+    QImageWriter imageWriter(device, format);
+    imageWriter.setQuality(settings.quality);
+    imageWriter.setOptimizedWrite(settings.optimized);
+    imageWriter.setProgressiveScanWrite(settings.progressive);
+    if (!imageWriter.canWrite() || !imageWriter.write(image)) {
+        *errorString = imageWriter.errorString();
         return false;
     }
     return true;
 }
 
-bool ExportManager::remoteSave(const QUrl &url, const QString &mimetype)
+QString ExportManager::encodedImageKey(const QByteArray &format, EncodingProfile profile) const
 {
+    return QStringLiteral("%1:%2:%3").arg(mSaveImage.cacheKey())
+                                     .arg(QString::fromLatin1(format.toLower()))
+                                     .arg(static_cast<int>(profile));
+}
 
+void ExportManager::writeImageFile(SaveRequest *request)
+{
+    // streamed saves are already on disk when they're queued
+
+    if (request->cancelled.load() || request->written) {
+        return;
+    }
+
+    const QFileInfo fileInfo(request->filePath);
+    if (!fileInfo.dir().mkpath(QStringLiteral("."))) {
+        request->errorString = i18n("Cannot create the folder %1", fileInfo.path());
+        return;
+    }
+
+    // QSaveFile writes to a temporary file and only renames it to the
+    // real name once the data has been flushed to disk
+
+    QSaveFile file(request->filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        request->errorString = file.errorString();
+        return;
+    }
+
+    if (request->encoded.isEmpty()) {
+        QBuffer buffer(&request->encoded);
+        buffer.open(QIODevice::WriteOnly);
+        if (!writeImage(&buffer, request->image, request->format, request->encoding, &request->errorString)) {
+            request->encoded.clear();
+            file.cancelWriting();
+            return;
+        }
+        request->image = QImage();
+    }
+
+    if (file.write(request->encoded) != request->encoded.size()) {
+        request->errorString = file.errorString();
+        file.cancelWriting();
+        return;
+    }
+
+    if (request->cancelled.load()) {
+        file.cancelWriting();
+        return;
+    }
+    if (!file.commit()) {
+        request->errorString = file.errorString();
+        return;
+    }
+
+    if (request->kind == SaveKind::Temporary) {
+        // try to make sure 3rd-party which gets the url of the temporary file e.g. on export
+        // properly treats this as readonly, also hide from other users
+        QFile::setPermissions(request->filePath, QFile::ReadUser);
+    }
+    request->written = true;
+}
+
+void ExportManager::imageFileWritten(SaveRequest *request)
+{
+    if (request->finished) {
+        return;
+    }
+
+    if (request->cancelled.load()) {
+        if (!request->url.isLocalFile()) {
+            QFile::remove(request->filePath);
+        }
+        completeSave(request, false);
+        return;
+    }
+
+    // the cache only holds the current screenshot, which may have been
+    // replaced while the file was written
+
+    if (request->written && !request->encodedKey.isEmpty() && request->imageKey == mSaveImage.cacheKey()) {
+        mEncodedImages.insert(request->encodedKey, request->encoded);
+    }
+    request->encoded.clear();
+
+    if (!request->written) {
+        if (!request->url.isLocalFile()) {
+            QFile::remove(request->filePath);
+        }
+        if (request->kind == SaveKind::Temporary) {
+            completeSave(request, false, i18n("Cannot save screenshot. Error while writing temporary local file."));
+        } else {
+            completeSave(request, false, i18n("Cannot save screenshot. Error while writing file: %1", request->errorString));
+        }
+        return;
+    }
+
+    if (request->url.isLocalFile()) {
+        completeSave(request, true);
+    } else {
+        uploadImageFile(request);
+    }
+}
+
+void ExportManager::uploadImageFile(SaveRequest *request)
+{
     // Check if remote save directory exists
-    const QUrl dirPath(url.adjusted(QUrl::RemoveFilename));
+    const QUrl dirPath(request->url.adjusted(QUrl::RemoveFilename));
     KIO::ListJob *listJob = KIO::listDir(dirPath);
-    listJob->exec();
+    request->job = listJob;
+
+    connect(listJob, &KJob::result, this, [this, request, dirPath](KJob *job) {
+        request->job = nullptr;
+        if (job->error() == KJob::NoError || request->cancelled.load()) {
+            startUpload(request);
+            return;
+        }
 
-    if (listJob->error() != KJob::NoError) {
         // Create remote save directory
         KIO::MkpathJob *mkpathJob = KIO::mkpath(dirPath, QUrl(defaultSaveLocation()));
-        mkpathJob->exec();
+        request->job = mkpathJob;
+        connect(mkpathJob, &KJob::result, this, [this, request, dirPath](KJob *job) {
+            request->job = nullptr;
+            if (job->error() != KJob::NoError) {
+                QFile::remove(request->filePath);
+                completeSave(request, false, xi18nc("@info",
+                                                    "Cannot save screenshot because creating the "
+                                                    "remote directory failed:<nl/><filename>%1</filename>",
+                                                    dirPath.path()));
+                return;
+            }
+            startUpload(request);
+        });
+    });
+}
 
-        if (mkpathJob->error() != KJob::NoError) {
-            emit errorMessage(xi18nc("@info",
-                                     "Cannot save screenshot because creating the "
-                                     "remote directory failed:<nl/><filename>%1</filename>",
-                                     dirPath.path()));
-            return false;
+void ExportManager::startUpload(SaveRequest *request)
+{
+    if (request->cancelled.load()) {
+        QFile::remove(request->filePath);
+        completeSave(request, false);
+        return;
+    }
+
+    KIO::FileCopyJob *uploadJob = KIO::file_copy(QUrl::fromLocalFile(request->filePath), request->url);
+    request->job = uploadJob;
+    connect(uploadJob, &KJob::result, this, [this, request](KJob *job) {
+        request->job = nullptr;
+        QFile::remove(request->filePath);
+
+        if (job->error() != KJob::NoError) {
+            completeSave(request, false, i18n("Unable to save image. Could not upload file to remote location."));
+            return;
+        }
+        completeSave(request, true);
+    });
+}
+
+void ExportManager::completeSave(SaveRequest *request, bool success, const QString &errorString)
+{
+    request->finished = true;
+    request->success = success;
+    request->errorString = errorString;
+    flushFinishedSaves();
+}
+
+void ExportManager::flushFinishedSaves()
+{
+    while (!mPendingSaves.isEmpty() && mPendingSaves.first()->finished) {
+        SaveRequest *request = mPendingSaves.takeFirst();
+        mSaveBatchFinished++;
+
+        // temporary files are handed out by tempSave() as soon as they're
+        // written, the files of a group are reported with the last of them
+
+        if (request->group) {
+            finishGroupedSave(request);
+        } else if (request->success && request->kind != SaveKind::Temporary) {
+            if (request->kind == SaveKind::SaveAs) {
+                SpectacleConfig::instance()->setLastSaveAsFile(request->url);
+            }
+            emit imageSaved(request->url);
+            if (request->notify) {
+                emit forceNotify(request->url);
+            }
+        } else if (!request->success && !request->cancelled.load()) {
+            emit errorMessage(request->errorString);
         }
+
+        emit saveFinished(request->url, request->success);
+
+        request->watcher->disconnect(this);
+        request->watcher->deleteLater();
+        delete request;
     }
 
-    QTemporaryFile tmpFile;
+    emit saveProgress(mSaveBatchFinished, mSaveBatchTotal);
+    if (mPendingSaves.isEmpty()) {
+        mSaveBatchFinished = 0;
+        mSaveBatchTotal = 0;
+    }
+}
 
-    if (tmpFile.open()) {
-        if(!writeImage(&tmpFile, mimetype.toLatin1())) {
-            emit errorMessage(i18n("Cannot save screenshot. Error while writing temporary local file."));
-            return false;
+void ExportManager::finishGroupedSave(SaveRequest *request)
+{
+    SaveGroup *group = request->group.data();
+    group->remaining--;
+    if (request->success) {
+        group->savedCount++;
+    } else if (!request->cancelled.load()) {
+        group->failedCount++;
+    }
+    if (group->remaining > 0) {
+        return;
+    }
+
+    if (group->failedCount > 0) {
+        if (group->savedCount == 0) {
+            emit errorMessage(i18n("Cannot save screenshot. Error while writing file."));
+        } else {
+            emit errorMessage(i18np("Cannot save the screenshot of one window. Error while writing file.",
+                                    "Cannot save the screenshots of %1 windows. Error while writing files.",
+                                    group->failedCount));
         }
+    }
+    if (group->savedCount > 0) {
+        emit imageSaved(group->url);
+        if (group->notify) {
+            emit forceNotify(group->url);
+        }
+    }
+    emit saveFinished(group->url, group->savedCount > 0);
+}
 
-        KIO::FileCopyJob *uploadJob = KIO::file_copy(QUrl::fromLocalFile(tmpFile.fileName()), url);
-        uploadJob->exec();
+bool ExportManager::hasPendingSaves() const
+{
+    return !mPendingSaves.isEmpty();
+}
 
-        if (uploadJob->error() != KJob::NoError) {
-            emit errorMessage(i18n("Unable to save image. Could not upload file to remote location."));
-            return false;
+void ExportManager::waitForPendingSaves()
+{
+    // remote saves still need the event loop for their upload
+
+    while (!mPendingSaves.isEmpty()) {
+        SaveRequest *request = mPendingSaves.first();
+        if (!request->written && !request->finished) {
+            request->watcher->waitForFinished();
+            imageFileWritten(request);
+        } else {
+            QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
         }
-        return true;
     }
+}
 
-    return false;
+void ExportManager::onSaveFinished(const QUrl &url, QObject *context, const std::function<void(bool)> &callback)
+{
+    QSharedPointer<QMetaObject::Connection> connection = QSharedPointer<QMetaObject::Connection>::create();
+    *connection = connect(this, &ExportManager::saveFinished, context, [url, callback, connection](const QUrl &savedUrl, bool success) {
+        if (savedUrl != url) {
+            return;
+        }
+        QObject::disconnect(*connection);
+        callback(success);
+    });
+}
+
+void ExportManager::cancelSaves()
+{
+    for (SaveRequest *request : mPendingSaves) {
+        request->cancelled.store(1);
+        if (request->job) {
+            request->job->kill(KJob::EmitResult);
+        }
+    }
 }
 
 QUrl ExportManager::tempSave(const QString &mimetype)
@@ -375,15 +757,20 @@ QUrl ExportManager::tempSave(const QString &mimetype)
         const QString baseFileName = mTempDir->path() + QDir::separator() + makeAutosaveFilename();
         const QString fileName = autoIncrementFilename(baseFileName, mimetype,
                                                        &ExportManager::isTempFileAlreadyUsed);
-        QFile tmpFile(fileName);
-        if (tmpFile.open(QFile::WriteOnly)) {
-            if(writeImage(&tmpFile, mimetype.toLatin1())) {
-                mTempFile = QUrl::fromLocalFile(tmpFile.fileName());
-                // try to make sure 3rd-party which gets the url of the temporary file e.g. on export
-                // properly treats this as readonly, also hide from other users
-                tmpFile.setPermissions(QFile::ReadUser);
+
+        // the caller needs the file right away. the pool runs the request
+        // on this thread if it didn't get to it yet
+
+        SaveRequest *request = save(QUrl::fromLocalFile(fileName), mimetype, SaveKind::Temporary, false);
+        if (request) {
+            request->watcher->waitForFinished();
+            const bool written = request->written;
+            imageFileWritten(request);
+            if (written) {
+                mTempFile = QUrl::fromLocalFile(fileName);
                 return mTempFile;
             }
+            return QUrl();
         }
     }
 
@@ -391,20 +778,6 @@ QUrl ExportManager::tempSave(const QString &mimetype)
     return QUrl();
 }
 
-bool ExportManager::save(const QUrl &url)
-{
-    if (!(url.isValid())) {
-        emit errorMessage(i18n("Cannot save screenshot. The save filename is invalid."));
-        return false;
-    }
-
-    QString mimetype = makeSaveMimetype(url);
-    if (url.isLocalFile()) {
-        return localSave(url, mimetype);
-    }
-    return remoteSave(url, mimetype);
-}
-
 bool ExportManager::isFileExists(const QUrl &url) const
 {
     if (!(url.isValid())) {
@@ -424,27 +797,150 @@ bool ExportManager::isTempFileAlreadyUsed(const QUrl &url) const
 
 // save slots
 
-void ExportManager::doSave(const QUrl &url, bool notify)
+QUrl ExportManager::doSave(const QUrl &url, bool notify)
 {
-    if (mSavePixmap.isNull()) {
+    if (mSaveImage.isNull()) {
         emit errorMessage(i18n("Cannot save an empty screenshot image."));
-        return;
+        return QUrl();
     }
 
-    QUrl savePath = url.isValid() ? url : getAutosaveFilename();
-    if (save(savePath)) {
-        QDir dir(savePath.path());
-        dir.cdUp();
-        SpectacleConfig::instance()->setLastSaveFile(savePath);
+    const QUrl savePath = url.isValid() ? url : getAutosaveFilename();
+    if (!save(savePath, makeSaveMimetype(savePath), SaveKind::Save, notify)) {
+        return QUrl();
+    }
+    return savePath;
+}
+
+// streamed saving bypasses mSaveImage entirely. the grabber hands the
+// image over in bands, which are encoded as they come in
 
-        emit imageSaved(savePath);
-        if (notify) {
-            emit forceNotify(savePath);
+bool ExportManager::isStreamSaveSupported(const QUrl &url) const
+{
+    if (url.isValid()) {
+        return url.isLocalFile() && QMimeDatabase().mimeTypeForUrl(url).preferredSuffix() == QStringLiteral("png");
+    }
+    return SpectacleConfig::instance()->saveImageFormat() == QStringLiteral("png");
+}
+
+QUrl ExportManager::doStreamSave(ImageGrabber *grabber, const QUrl &url, bool notify)
+{
+    const QUrl savePath = url.isValid() ? url : getAutosaveFilename();
+    if (!savePath.isValid() || !isStreamSaveSupported(savePath)) {
+        emit errorMessage(i18n("Cannot save screenshot. The save filename is invalid."));
+        return QUrl();
+    }
+
+    const QUrl dirPath(savePath.adjusted(QUrl::RemoveFilename));
+    const QDir dir(dirPath.path());
+    if (!dir.mkpath(QStringLiteral("."))) {
+        emit errorMessage(xi18nc("@info",
+                                 "Cannot save screenshot because creating "
+                                 "the directory failed:<nl/><filename>%1</filename>",
+                                 dirPath.path()));
+        return QUrl();
+    }
+
+    // the bands are encoded and written as the grabber hands them over, so
+    // only one of them is held at a time. the file is complete once the
+    // grab is, the save pool only reports it in order with the other saves
+
+    QSaveFile file(savePath.toLocalFile());
+    if (!file.open(QIODevice::WriteOnly)) {
+        emit errorMessage(i18n("Cannot save screenshot. Error while writing file: %1", file.errorString()));
+        return QUrl();
+    }
+
+    PngStreamWriter writer(&file);
+    writer.setCompressionLevel(SpectacleConfig::instance()->encodingSettings(encodingProfile()).compression);
+    if (!grabber->doStreamGrab(&writer)) {
+        file.cancelWriting();
+        if (writer.errorString().isEmpty()) {
+            emit errorMessage(i18n("Screenshot capture canceled or failed"));
+        } else {
+            emit errorMessage(i18n("Cannot save screenshot. Error while writing file: %1", writer.errorString()));
+        }
+        return QUrl();
+    }
+    if (!file.commit()) {
+        emit errorMessage(i18n("Cannot save screenshot. Error while writing file: %1", file.errorString()));
+        return QUrl();
+    }
+
+    SaveRequest *request = newSaveRequest(savePath, QStringLiteral("png"), SaveKind::Save, notify);
+    if (!request) {
+        return QUrl();
+    }
+    request->written = true;
+    startSave(request);
+    return savePath;
+}
+
+// the images of an AllWindows grab go into a directory of their own, one
+// file per window, named after the window title
+
+QUrl ExportManager::doSaveWindowImages(const QVector<ImageGrabber::WindowImage> &images, const QUrl &url, bool notify)
+{
+    if (url.isValid() && !url.isLocalFile()) {
+        emit errorMessage(i18n("Cannot save screenshots. Window screenshots can only be saved to a local folder."));
+        return QUrl();
+    }
+
+    const QString dirPath = url.isValid() ? url.toLocalFile() : makeAutosaveDirectory();
+    const QDir dir(dirPath);
+    if (!dir.mkpath(QStringLiteral("."))) {
+        emit errorMessage(xi18nc("@info",
+                                 "Cannot save screenshot because creating "
+                                 "the directory failed:<nl/><filename>%1</filename>",
+                                 dirPath));
+        return QUrl();
+    }
+
+    const QUrl savePath = QUrl::fromLocalFile(dirPath);
+    QSharedPointer<SaveGroup> group = QSharedPointer<SaveGroup>::create();
+    group->url = savePath;
+    group->notify = notify;
+    group->remaining = 0;
+    group->savedCount = 0;
+    group->failedCount = 0;
+
+    // the images are independent of each other, so the pool encodes them
+    // in parallel. they're reported as one once the last file is written
+
+    const QString extension = SpectacleConfig::instance()->saveImageFormat();
+    const EncodingSettings encoding = SpectacleConfig::instance()->encodingSettings(encodingProfile());
+    QSet<QString> usedNames;
+    for (const ImageGrabber::WindowImage &windowImage : images) {
+        QString baseName = windowImage.title.simplified().replace(QLatin1String("/"), QLatin1String("_"));  // POSIX doesn't allow "/" in filenames
+        if (baseName.isEmpty() || baseName.startsWith(QLatin1Char('.'))) {
+            baseName.prepend(i18nc("Filename of a window screenshot without a window title", "Window"));
+        }
+        baseName = truncatedFilename(baseName);
+
+        QString name = baseName;
+        for (quint64 i = 1; usedNames.contains(name) || dir.exists(name + QLatin1Char('.') + extension); i++) {
+            name = baseName + QStringLiteral("-%1").arg(i);
         }
+        usedNames.insert(name);
+
+        const QUrl fileUrl = QUrl::fromLocalFile(dir.filePath(name + QLatin1Char('.') + extension));
+        SaveRequest *request = newSaveRequest(fileUrl, extension, SaveKind::Save, false);
+        if (!request) {
+            continue;
+        }
+        request->image = windowImage.image;
+        request->encoding = encoding;
+        request->group = group;
+        group->remaining++;
+        startSave(request);
+    }
+
+    if (group->remaining == 0) {
+        return QUrl();
     }
+    return savePath;
 }
 
-bool ExportManager::doSaveAs(QWidget *parentWindow, bool notify)
+QUrl ExportManager::doSaveAs(QWidget *parentWindow, bool notify)
 {
     QStringList supportedFilters;
     SpectacleConfig *config = SpectacleConfig::instance();
@@ -469,26 +965,18 @@ bool ExportManager::doSaveAs(QWidget *parentWindow, bool notify)
     // launch the dialog
     if (dialog.exec() == QFileDialog::Accepted) {
         const QUrl saveUrl = dialog.selectedUrls().first();
-        if (saveUrl.isValid()) {
-            if (save(saveUrl)) {
-                emit imageSaved(saveUrl);
-                config->setLastSaveAsFile(saveUrl);
-
-                if (notify) {
-                    emit forceNotify(saveUrl);
-                }
-                return true;
-            }
+        if (save(saveUrl, makeSaveMimetype(saveUrl), SaveKind::SaveAs, notify)) {
+            return saveUrl;
         }
     }
-    return false;
+    return QUrl();
 }
 
 // misc helpers
 
 void ExportManager::doCopyToClipboard()
 {
-    QApplication::clipboard()->setPixmap(mSavePixmap, QClipboard::Clipboard);
+    QApplication::clipboard()->setImage(mSaveImage, QClipboard::Clipboard);
 }
 
 void ExportManager::doPrint(QPrinter *printer)
@@ -502,11 +990,11 @@ void ExportManager::doPrint(QPrinter *printer)
     }
 
     QRect devRect(0, 0, printer->width(), printer->height());
-    QPixmap pixmap = mSavePixmap.scaled(devRect.size(), Qt::KeepAspectRatio, Qt::SmoothTransformation);
-    QRect srcRect = pixmap.rect();
+    QImage image = mSaveImage.scaled(devRect.size(), Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    QRect srcRect = image.rect();
     srcRect.moveCenter(devRect.center());
 
-    painter.drawPixmap(srcRect.topLeft(), pixmap);
+    painter.drawImage(srcRect.topLeft(), image);
     painter.end();
 
     delete printer;
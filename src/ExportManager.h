@@ -23,11 +23,16 @@
 #include <QObject>
 #include <QIODevice>
 #include <QPrinter>
-#include <QPixmap>
+#include <QImage>
 #include <QDateTime>
+#include <QHash>
+#include <QThreadPool>
 #include <QUrl>
 
+#include <functional>
+
 #include "PlatformBackends/ImageGrabber.h"
+#include "SpectacleConfig.h"
 
 class QTemporaryDir;
 
@@ -53,25 +58,40 @@ class ExportManager : public QObject
 
     public:
 
-    Q_PROPERTY(QPixmap pixmap READ pixmap WRITE setPixmap NOTIFY pixmapChanged)
+    Q_PROPERTY(QImage image READ image WRITE setImage NOTIFY imageChanged)
     Q_PROPERTY(QString windowTitle READ windowTitle WRITE setWindowTitle)
     Q_PROPERTY(ImageGrabber::GrabMode grabMode READ grabMode WRITE setGrabMode)
 
     QString defaultSaveLocation() const;
     bool isFileExists(const QUrl &url) const;
-    void setPixmap(const QPixmap &pixmap);
-    QPixmap pixmap() const;
-    void updatePixmapTimestamp();
+    void setImage(const QImage &image);
+    QImage image() const;
+    void updateImageTimestamp();
     void setWindowTitle(const QString &windowTitle);
     QString windowTitle() const;
     ImageGrabber::GrabMode grabMode() const;
     void setGrabMode(const ImageGrabber::GrabMode &grabMode);
+    bool isStreamSaveSupported(const QUrl &url) const;
+
+    // the profile for saved screenshots, overriding the configured one.
+    // temporary files always use the configured profile
+    EncodingProfile encodingProfile() const;
+    void setEncodingProfile(EncodingProfile profile);
+
+    // saves run in the background, in the order they were started
+    bool hasPendingSaves() const;
+    void waitForPendingSaves();
+
+    // calls back once when the save to the url is done, successfully or not
+    void onSaveFinished(const QUrl &url, QObject *context, const std::function<void(bool)> &callback);
 
     Q_SIGNALS:
 
     void errorMessage(const QString &str);
-    void pixmapChanged(const QPixmap &pixmap);
+    void imageChanged(const QImage &image);
     void imageSaved(const QUrl &savedAt);
+    void saveFinished(const QUrl &url, bool success);
+    void saveProgress(int finishedCount, int totalCount);
     void forceNotify(const QUrl &savedAt);
 
     public Q_SLOTS:
@@ -79,32 +99,63 @@ class ExportManager : public QObject
     QUrl getAutosaveFilename();
     QUrl tempSave(const QString &mimetype = QStringLiteral("png"));
 
-    void doSave(const QUrl &url = QUrl(), bool notify = false);
-    bool doSaveAs(QWidget *parentWindow = nullptr, bool notify = false);
+    // these return the url the image is being saved to, or an empty url if
+    // the save couldn't be started
+    QUrl doSave(const QUrl &url = QUrl(), bool notify = false);
+    QUrl doStreamSave(ImageGrabber *grabber, const QUrl &url = QUrl(), bool notify = false);
+    QUrl doSaveWindowImages(const QVector<ImageGrabber::WindowImage> &images, const QUrl &url = QUrl(), bool notify = false);
+    QUrl doSaveAs(QWidget *parentWindow = nullptr, bool notify = false);
+    void cancelSaves();
     void doCopyToClipboard();
     void doPrint(QPrinter *printer);
 
     private:
 
+    enum class SaveKind {
+        Save,
+        SaveAs,
+        Temporary
+    };
+
+    struct SaveRequest;
+    struct SaveGroup;
+
     QString truncatedFilename(const QString &filename);
     QString makeAutosaveFilename();
+    QString makeAutosaveDirectory();
     using FileNameAlreadyUsedCheck = bool (ExportManager::*)(const QUrl&) const;
     QString autoIncrementFilename(const QString &baseName, const QString &extension,
                                   FileNameAlreadyUsedCheck isFileNameUsed);
     QString makeSaveMimetype(const QUrl &url);
-    bool writeImage(QIODevice *device, const QByteArray &format);
-    bool save(const QUrl &url);
-    bool localSave(const QUrl &url, const QString &mimetype);
-    bool remoteSave(const QUrl &url, const QString &mimetype);
+    SaveRequest *save(const QUrl &url, const QString &mimetype, SaveKind kind, bool notify);
+    SaveRequest *newSaveRequest(const QUrl &url, const QString &mimetype, SaveKind kind, bool notify);
+    void startSave(SaveRequest *request);
+    QString encodedImageKey(const QByteArray &format, EncodingProfile profile) const;
+    static bool writeImage(QIODevice *device, const QImage &image, const QByteArray &format,
+                           const EncodingSettings &settings, QString *errorString);
+    static void writeImageFile(SaveRequest *request);
+    void imageFileWritten(SaveRequest *request);
+    void uploadImageFile(SaveRequest *request);
+    void startUpload(SaveRequest *request);
+    void completeSave(SaveRequest *request, bool success, const QString &errorString = QString());
+    void flushFinishedSaves();
+    void finishGroupedSave(SaveRequest *request);
     bool isTempFileAlreadyUsed(const QUrl &url) const;
 
-    QPixmap mSavePixmap;
-    QDateTime mPixmapTimestamp;
+    QImage mSaveImage;
+    QDateTime mImageTimestamp;
     QUrl mTempFile;
     QTemporaryDir *mTempDir;
     QList<QUrl> mUsedTempFileNames;
     QString mWindowTitle;
     ImageGrabber::GrabMode mGrabMode;
+    EncodingProfile mEncodingProfile;
+    bool mEncodingProfileSet;
+    QThreadPool mSavePool;
+    QList<SaveRequest *> mPendingSaves;
+    int mSaveBatchFinished;
+    int mSaveBatchTotal;
+    QHash<QString, QByteArray> mEncodedImages;
 };
 
 #endif // EXPORTMANAGER_H
@@ -85,10 +85,15 @@ void ExportMenu::getKServiceItems()
         QAction *action = new QAction(QIcon::fromTheme(service->icon()), name, this);
 
         connect(action, &QAction::triggered, [=]() {
-            const QUrl filename = mExportManager->getAutosaveFilename();
-            mExportManager->doSave(filename);
-            QList<QUrl> whereIs({ filename });
-            KRun::runService(*service, whereIs, parentWidget(), true);
+            const QUrl filename = mExportManager->doSave(mExportManager->getAutosaveFilename());
+            if (!filename.isValid()) {
+                return;
+            }
+            mExportManager->onSaveFinished(filename, this, [=](bool success) {
+                if (success) {
+                    KRun::runService(*service, QList<QUrl>({ filename }), parentWidget(), true);
+                }
+            });
         });
         addAction(action);
     }
@@ -104,10 +109,15 @@ void ExportMenu::getKServiceItems()
     openWith->setShortcuts(KStandardShortcut::open());
 
     connect(openWith, &QAction::triggered, [=]() {
-        const QUrl filename = mExportManager->getAutosaveFilename();
-        mExportManager->doSave(filename);
-        QList<QUrl> whereIs({ filename });
-        KRun::displayOpenWithDialog(whereIs, parentWidget(), true);
+        const QUrl filename = mExportManager->doSave(mExportManager->getAutosaveFilename());
+        if (!filename.isValid()) {
+            return;
+        }
+        mExportManager->onSaveFinished(filename, this, [=](bool success) {
+            if (success) {
+                KRun::displayOpenWithDialog(QList<QUrl>({ filename }), parentWidget(), true);
+            }
+        });
     });
     addAction(openWith);
 }
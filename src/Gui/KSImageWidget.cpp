@@ -21,7 +21,7 @@
 
 KSImageWidget::KSImageWidget(QWidget *parent):
     QLabel(parent),
-    mPixmap(QPixmap())
+    mImage(QImage())
 {
     mDSEffect = new QGraphicsDropShadowEffect(this);
 
@@ -35,17 +35,18 @@ KSImageWidget::KSImageWidget(QWidget *parent):
     setMinimumSize(size());
 }
 
-void KSImageWidget::setScreenshot(const QPixmap &pixmap)
+void KSImageWidget::setScreenshot(const QImage &image)
 {
-    mPixmap = pixmap;
-    setToolTip(i18n("Image Size: %1x%2 pixels", mPixmap.width(), mPixmap.height()));
+    mImage = image;
+    setToolTip(i18n("Image Size: %1x%2 pixels", mImage.width(), mImage.height()));
     setScaledPixmap();
 }
 
 void KSImageWidget::setScaledPixmap()
 {
     const qreal scale = qApp->devicePixelRatio();
-    QPixmap scaledPixmap = mPixmap.scaled(size() * scale, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    // only the preview is turned into a pixmap, never the full screenshot
+    QPixmap scaledPixmap = QPixmap::fromImage(mImage.scaled(size() * scale, Qt::KeepAspectRatio, Qt::SmoothTransformation));
     scaledPixmap.setDevicePixelRatio(scale);
     setPixmap(scaledPixmap);
 }
@@ -26,7 +26,7 @@
 #include <QColor>
 #include <QMouseEvent>
 #include <QPoint>
-#include <QPixmap>
+#include <QImage>
 #include <QGraphicsDropShadowEffect>
 
 #include <KLocalizedString>
@@ -43,7 +43,7 @@ class KSImageWidget : public QLabel
     public:
 
     explicit KSImageWidget(QWidget *parent = nullptr);
-    void setScreenshot(const QPixmap &pixmap);
+    void setScreenshot(const QImage &image);
 
     Q_SIGNALS:
 
@@ -61,7 +61,7 @@ class KSImageWidget : public QLabel
     void setScaledPixmap();
 
     QGraphicsDropShadowEffect *mDSEffect;
-    QPixmap                    mPixmap;
+    QImage                     mImage;
     QPoint                     mDragStartPosition;
 };
 
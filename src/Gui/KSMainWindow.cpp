@@ -63,6 +63,7 @@ KSMainWindow::KSMainWindow(const QVector<ImageGrabber::GrabMode>& supportedModes
     mSaveAsAction(new QAction(this)),
     mSaveAction(new QAction(this)),
     mMessageWidget(new KMessageWidget(this)),
+    mSaveProgressWidget(new KMessageWidget(this)),
     mToolsMenu(new QMenu(this)),
     mScreenRecorderToolsMenu(new QMenu(this)),
     mExportMenu(new ExportMenu(this)),
@@ -190,6 +191,16 @@ void KSMainWindow::init()
     // message widget
     connect(mMessageWidget, &KMessageWidget::linkActivated, this, [](const QString &str) { QDesktopServices::openUrl(QUrl(str)); } );
 
+    // save progress, for saves that take a while
+
+    QAction *cancelSavesAction = new QAction(QIcon::fromTheme(QStringLiteral("dialog-cancel")), i18n("Cancel"), this);
+    connect(cancelSavesAction, &QAction::triggered, ExportManager::instance(), &ExportManager::cancelSaves);
+    mSaveProgressWidget->setMessageType(KMessageWidget::Information);
+    mSaveProgressWidget->setIcon(QIcon::fromTheme(QStringLiteral("document-save")));
+    mSaveProgressWidget->setCloseButtonVisible(false);
+    mSaveProgressWidget->addAction(cancelSavesAction);
+    connect(ExportManager::instance(), &ExportManager::saveProgress, this, &KSMainWindow::showSaveProgress);
+
     // layouts
 
     mDivider->setFrameShape(QFrame::HLine);
@@ -198,9 +209,11 @@ void KSMainWindow::init()
     QVBoxLayout *layout = new QVBoxLayout(this);
     layout->addWidget(mKSWidget);
     layout->addWidget(mMessageWidget);
+    layout->addWidget(mSaveProgressWidget);
     layout->addWidget(mDivider);
     layout->addWidget(mDialogButtonBox);
     mMessageWidget->hide();
+    mSaveProgressWidget->hide();
 
     // populate our send-to actions
 
@@ -222,14 +235,14 @@ void KSMainWindow::init()
     // done with the init
 }
 
-int KSMainWindow::windowWidth(const QPixmap &pixmap) const
+int KSMainWindow::windowWidth(const QImage &image) const
 {
     // Calculates what the width of the window should be for the captured image to perfectly fit
     // the area reserved for the image, with the height already set.
 
-    const float pixmapAspectRatio = (float)pixmap.width() / pixmap.height();
+    const float imageAspectRatio = (float)image.width() / image.height();
     const int imageHeight = mKSWidget->height() - 2 * layout()->spacing();
-    const int imageWidth = pixmapAspectRatio * imageHeight;
+    const int imageWidth = imageAspectRatio * imageHeight;
 
     int alignedWindowWidth = qMin(mKSWidget->imagePaddingWidth() + imageWidth, MAXIMUM_WINDOW_WIDTH);
     alignedWindowWidth += layout()->contentsMargins().left() + layout()->contentsMargins().right();
@@ -274,9 +287,9 @@ void KSMainWindow::captureScreenshot(ImageGrabber::GrabMode mode, int timeout, b
     emit newScreenshotRequest(mode, timeout, includePointer, includeDecorations);
 }
 
-void KSMainWindow::setScreenshotAndShow(const QPixmap &pixmap)
+void KSMainWindow::setScreenshotAndShow(const QImage &image)
 {
-    mKSWidget->setScreenshotPixmap(pixmap);
+    mKSWidget->setScreenshot(image);
     mExportMenu->imageUpdated();
 
     setWindowTitle(i18nc("@title:window Unsaved Screenshot", "Unsaved[*]"));
@@ -284,7 +297,7 @@ void KSMainWindow::setScreenshotAndShow(const QPixmap &pixmap)
 
     show();
 
-    resize(QSize(windowWidth(pixmap), DEFAULT_WINDOW_HEIGHT));
+    resize(QSize(windowWidth(image), DEFAULT_WINDOW_HEIGHT));
 }
 
 void KSMainWindow::showPrintDialog()
@@ -387,6 +400,30 @@ void KSMainWindow::showImageSharedFeedback(bool error, const QString &message)
     }
 }
 
+void KSMainWindow::showSaveProgress(int finishedCount, int totalCount)
+{
+    if (finishedCount >= totalCount) {
+        if (!mSaveProgressWidget->isHidden()) {
+            mSaveProgressWidget->animatedHide();
+        }
+        return;
+    }
+
+    if (totalCount == 1) {
+        mSaveProgressWidget->setText(i18n("Saving the screenshot..."));
+    } else {
+        mSaveProgressWidget->setText(i18n("Saving screenshots, %1 of %2 done...", finishedCount, totalCount));
+    }
+
+    // most saves are done before anyone could read the message
+
+    QTimer::singleShot(500, this, [this] {
+        if (mSaveProgressWidget->isHidden() && ExportManager::instance()->hasPendingSaves()) {
+            mSaveProgressWidget->animatedShow();
+        }
+    });
+}
+
 void KSMainWindow::sendToClipboard()
 {
     ExportManager::instance()->doCopyToClipboard();
@@ -415,9 +452,9 @@ void KSMainWindow::save()
     setDefaultSaveAction();
 
     const bool quitChecked = SpectacleConfig::instance()->quitAfterSaveOrCopyChecked();
-    ExportManager::instance()->doSave(QUrl(), /* notify */ quitChecked);
-    if (quitChecked) {
-        quit(QuitBehavior::QuitExternally);
+    const QUrl saveUrl = ExportManager::instance()->doSave(QUrl(), /* notify */ quitChecked);
+    if (quitChecked && saveUrl.isValid()) {
+        quitAfterSave(saveUrl);
     }
 }
 
@@ -427,7 +464,19 @@ void KSMainWindow::saveAs()
     setDefaultSaveAction();
 
     const bool quitChecked = SpectacleConfig::instance()->quitAfterSaveOrCopyChecked();
-    if (ExportManager::instance()->doSaveAs(this, /* notify */ quitChecked) && quitChecked) {
-        quit(QuitBehavior::QuitExternally);
+    const QUrl saveUrl = ExportManager::instance()->doSaveAs(this, /* notify */ quitChecked);
+    if (quitChecked && saveUrl.isValid()) {
+        quitAfterSave(saveUrl);
     }
 }
+
+void KSMainWindow::quitAfterSave(const QUrl &saveUrl)
+{
+    // saving runs in the background. stay around if it fails, so the
+    // screenshot isn't lost
+    ExportManager::instance()->onSaveFinished(saveUrl, this, [this](bool success) {
+        if (success) {
+            quit(QuitBehavior::QuitExternally);
+        }
+    });
+}
@@ -51,6 +51,7 @@ class KSMainWindow : public QDialog
         QuitExternally
     };
     void quit(const QuitBehavior quitBehavior = QuitBehavior::QuitImmediately);
+    void quitAfterSave(const QUrl &saveUrl);
 
     enum class MessageDuration {
         AutoHide,
@@ -67,16 +68,17 @@ class KSMainWindow : public QDialog
     void openScreenshotsFolder();
     void showPreferencesDialog();
     void showImageSharedFeedback(bool error, const QString &message);
+    void showSaveProgress(int finishedCount, int totalCount);
     void sendToClipboard();
     void init();
     void setDefaultSaveAction();
     void save();
     void saveAs();
-    int windowWidth(const QPixmap &pixmap) const;
+    int windowWidth(const QImage &image) const;
 
     public Q_SLOTS:
 
-    void setScreenshotAndShow(const QPixmap &pixmap);
+    void setScreenshotAndShow(const QImage &image);
     void setScreenshotWindowTitle(const QUrl &location);
 
     Q_SIGNALS:
@@ -102,6 +104,7 @@ class KSMainWindow : public QDialog
     QAction          *mSaveAsAction;
     QAction          *mSaveAction;
     KMessageWidget   *mMessageWidget;
+    KMessageWidget   *mSaveProgressWidget;
     QMenu            *mToolsMenu;
     QMenu            *mScreenRecorderToolsMenu;
     QScopedPointer<KMoreToolsMenuFactory> mScreenrecorderToolsMenuFactory;
@@ -190,9 +190,9 @@ int KSWidget::imagePaddingWidth() const
 
 // public slots
 
-void KSWidget::setScreenshotPixmap(const QPixmap &pixmap)
+void KSWidget::setScreenshot(const QImage &image)
 {
-    mImageWidget->setScreenshot(pixmap);
+    mImageWidget->setScreenshot(image);
 }
 
 void KSWidget::disableOnClick()
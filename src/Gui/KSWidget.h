@@ -21,7 +21,7 @@
 #define KSWIDGET_H
 
 #include <QWidget>
-#include <QPixmap>
+#include <QImage>
 
 #include "PlatformBackends/ImageGrabber.h"
 
@@ -54,7 +54,7 @@ class KSWidget : public QWidget
 
 	public Q_SLOTS:
 
-    void setScreenshotPixmap(const QPixmap &pixmap);
+    void setScreenshot(const QImage &image);
     void disableOnClick();
 
     private Q_SLOTS:
@@ -0,0 +1,56 @@
+/*
+ *  Copyright (C) 2019 The Spectacle Developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "ImageViews.h"
+
+static void releaseSourceImage(void *info)
+{
+    delete static_cast<QImage *>(info);
+}
+
+QImage ImageViews::crop(const QImage &image, const QRect &rect)
+{
+    const QRect area = rect.intersected(image.rect());
+    if (area.isEmpty()) {
+        return QImage();
+    }
+    if (area == image.rect()) {
+        return image;
+    }
+
+    // QImage wants every scanline to start on a 32-bit boundary
+    if (image.depth() < 32) {
+        return image.copy(area);
+    }
+
+    // the view holds a reference to the source image, which is dropped
+    // when the last copy of the view goes away. constBits() doesn't detach,
+    // so the pixels really are shared
+
+    QImage *source = new QImage(image);
+    const uchar *bits = source->constBits() + area.y() * source->bytesPerLine() + area.x() * (source->depth() / 8);
+
+    QImage view(bits, area.width(), area.height(), source->bytesPerLine(), source->format(), releaseSourceImage, source);
+    if (view.isNull()) {
+        delete source;
+        return image.copy(area);
+    }
+    view.setDevicePixelRatio(image.devicePixelRatio());
+    return view;
+}
@@ -0,0 +1,37 @@
+/*
+ *  Copyright (C) 2019 The Spectacle Developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#ifndef IMAGEVIEWS_H
+#define IMAGEVIEWS_H
+
+#include <QImage>
+#include <QRect>
+
+// Images that share the pixels of another image instead of copying them.
+// A view keeps the image it looks into alive, and like any other QImage it
+// only makes a copy of the pixels once somebody writes to it.
+
+namespace ImageViews
+{
+    // the part of image inside rect. formats with less than 32 bits per
+    // pixel can't be cut at arbitrary columns, those are copied
+    QImage crop(const QImage &image, const QRect &rect);
+}
+
+#endif // IMAGEVIEWS_H
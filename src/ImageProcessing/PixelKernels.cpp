@@ -0,0 +1,439 @@
+/*
+ *  Copyright (C) 2019 The Spectacle Developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "PixelKernels.h"
+
+#include <QColor>
+
+// the SIMD variants are compiled with per-function target attributes, so
+// that the rest of the program doesn't need to be built for a newer CPU
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PIXELKERNELS_X86 1
+#include <immintrin.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace {
+
+// generic implementations. these also handle the tails of the rows that
+// are too short for a full SIMD register
+
+inline quint32 bgr30ToRgb32Pixel(quint32 p)
+{
+    return 0xff000000 | ((p << 14) & 0x00ff0000) | ((p >> 4) & 0x0000ff00) | ((p >> 22) & 0x000000ff);
+}
+
+inline quint32 rgb16ToRgb32Pixel(quint32 c)
+{
+    return 0xff000000
+        | (((c << 3) & 0x0000f8) | ((c >> 2) & 0x000007))
+        | (((c << 5) & 0x00fc00) | ((c >> 1) & 0x000300))
+        | (((c << 8) & 0xf80000) | ((c << 3) & 0x070000));
+}
+
+void fillAlphaGeneric(quint32 *dst, const quint32 *src, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        dst[i] = src[i] | 0xff000000;
+    }
+}
+
+void bgr30ToRgb32Generic(quint32 *dst, const quint32 *src, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        dst[i] = bgr30ToRgb32Pixel(src[i]);
+    }
+}
+
+void rgb16ToRgb32Generic(quint32 *dst, const quint16 *src, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        dst[i] = rgb16ToRgb32Pixel(src[i]);
+    }
+}
+
+void unpremultiplyGeneric(quint32 *dst, const quint32 *src, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        dst[i] = qUnpremultiply(src[i]);
+    }
+}
+
+void boxBlurColumns8Generic(quint16 *dst, const quint16 *src, int count, int radius)
+{
+    // dividing by the box width is a fixed point multiplication, the same
+    // way the SIMD version does it
+    const uint width = 2 * radius + 1;
+    const uint inverse = (65536 + width / 2) / width;
+    const uint half = width / 2;
+
+    uint sums[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    for (int y = 0; y < qMin(radius, count); ++y) {
+        for (int i = 0; i < 8; ++i) {
+            sums[i] += src[y * 8 + i];
+        }
+    }
+
+    for (int y = 0; y < count; ++y) {
+        for (int i = 0; i < 8; ++i) {
+            if (y + radius < count) {
+                sums[i] += src[(y + radius) * 8 + i];
+            }
+            dst[y * 8 + i] = static_cast<quint16>(((sums[i] + half) * inverse) >> 16);
+            if (y - radius >= 0) {
+                sums[i] -= src[(y - radius) * 8 + i];
+            }
+        }
+    }
+}
+
+void blendPremultipliedGeneric(quint32 *dst, const quint32 *src, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        const uint alpha = qAlpha(src[i]);
+        if (alpha == 255) {
+            dst[i] = src[i];
+        } else if (alpha != 0) {
+            dst[i] = src[i] + PixelKernels::multiplyPixel(dst[i], 255 - alpha);
+        }
+    }
+}
+
+#ifdef PIXELKERNELS_X86
+
+// SSE2, four pixels at a time
+
+TARGET_SSE2 void fillAlphaSse2(quint32 *dst, const quint32 *src, int count)
+{
+    const __m128i alphaMask = _mm_set1_epi32(static_cast<int>(0xff000000));
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_or_si128(pixels, alphaMask));
+    }
+    fillAlphaGeneric(dst + i, src + i, count - i);
+}
+
+TARGET_SSE2 void bgr30ToRgb32Sse2(quint32 *dst, const quint32 *src, int count)
+{
+    const __m128i alphaMask = _mm_set1_epi32(static_cast<int>(0xff000000));
+    const __m128i redMask = _mm_set1_epi32(0x00ff0000);
+    const __m128i greenMask = _mm_set1_epi32(0x0000ff00);
+    const __m128i blueMask = _mm_set1_epi32(0x000000ff);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        const __m128i red = _mm_and_si128(_mm_slli_epi32(pixels, 14), redMask);
+        const __m128i green = _mm_and_si128(_mm_srli_epi32(pixels, 4), greenMask);
+        const __m128i blue = _mm_and_si128(_mm_srli_epi32(pixels, 22), blueMask);
+        const __m128i result = _mm_or_si128(_mm_or_si128(alphaMask, red), _mm_or_si128(green, blue));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), result);
+    }
+    bgr30ToRgb32Generic(dst + i, src + i, count - i);
+}
+
+TARGET_SSE2 inline __m128i rgb16ToRgb32x4(__m128i c)
+{
+    const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xff000000));
+    const __m128i blue = _mm_or_si128(_mm_and_si128(_mm_slli_epi32(c, 3), _mm_set1_epi32(0x0000f8)),
+                                      _mm_and_si128(_mm_srli_epi32(c, 2), _mm_set1_epi32(0x000007)));
+    const __m128i green = _mm_or_si128(_mm_and_si128(_mm_slli_epi32(c, 5), _mm_set1_epi32(0x00fc00)),
+                                       _mm_and_si128(_mm_srli_epi32(c, 1), _mm_set1_epi32(0x000300)));
+    const __m128i red = _mm_or_si128(_mm_and_si128(_mm_slli_epi32(c, 8), _mm_set1_epi32(0xf80000)),
+                                     _mm_and_si128(_mm_slli_epi32(c, 3), _mm_set1_epi32(0x070000)));
+    return _mm_or_si128(_mm_or_si128(alpha, red), _mm_or_si128(green, blue));
+}
+
+TARGET_SSE2 void rgb16ToRgb32Sse2(quint32 *dst, const quint16 *src, int count)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), rgb16ToRgb32x4(_mm_unpacklo_epi16(pixels, zero)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 4), rgb16ToRgb32x4(_mm_unpackhi_epi16(pixels, zero)));
+    }
+    rgb16ToRgb32Generic(dst + i, src + i, count - i);
+}
+
+TARGET_SSE2 inline __m128i unpremultiplyChannelx4(__m128i channel, __m128 scale)
+{
+    // channels larger than alpha are invalid, clamp them instead of wrapping
+    const __m128 value = _mm_min_ps(_mm_mul_ps(_mm_cvtepi32_ps(channel), scale), _mm_set1_ps(255.0f));
+    return _mm_cvtps_epi32(value);
+}
+
+TARGET_SSE2 void unpremultiplySse2(quint32 *dst, const quint32 *src, int count)
+{
+    const __m128i byteMask = _mm_set1_epi32(0xff);
+    const __m128i zero = _mm_setzero_si128();
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        const __m128i alpha = _mm_srli_epi32(pixels, 24);
+
+        // opaque pixels, by far the most common ones in screenshots, stay as they are
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, byteMask)) == 0xffff) {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), pixels);
+            continue;
+        }
+
+        const __m128 scale = _mm_div_ps(_mm_set1_ps(255.0f), _mm_cvtepi32_ps(alpha));
+        const __m128i red = unpremultiplyChannelx4(_mm_and_si128(_mm_srli_epi32(pixels, 16), byteMask), scale);
+        const __m128i green = unpremultiplyChannelx4(_mm_and_si128(_mm_srli_epi32(pixels, 8), byteMask), scale);
+        const __m128i blue = unpremultiplyChannelx4(_mm_and_si128(pixels, byteMask), scale);
+
+        __m128i result = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(alpha, 24), _mm_slli_epi32(red, 16)),
+                                      _mm_or_si128(_mm_slli_epi32(green, 8), blue));
+
+        // fully transparent pixels become transparent black, like in qUnpremultiply()
+        result = _mm_andnot_si128(_mm_cmpeq_epi32(alpha, zero), result);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), result);
+    }
+    unpremultiplyGeneric(dst + i, src + i, count - i);
+}
+
+TARGET_SSE2 inline __m128i multiplyChannelsx2(__m128i channels, __m128i factor)
+{
+    // (x * a + 128 + ((x * a + 128) >> 8)) >> 8, which is x * a / 255 rounded
+    const __m128i product = _mm_add_epi16(_mm_mullo_epi16(channels, factor), _mm_set1_epi16(0x80));
+    return _mm_srli_epi16(_mm_add_epi16(product, _mm_srli_epi16(product, 8)), 8);
+}
+
+TARGET_SSE2 void blendPremultipliedSse2(quint32 *dst, const quint32 *src, int count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i byteMask = _mm_set1_epi32(0xff);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i source = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        const __m128i alpha = _mm_srli_epi32(source, 24);
+
+        // most of a cursor image is fully transparent
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, zero)) == 0xffff) {
+            continue;
+        }
+
+        // spread 255 - alpha to the 16-bit lanes of all channels
+        __m128i inverse = _mm_sub_epi32(byteMask, alpha);
+        inverse = _mm_or_si128(inverse, _mm_slli_epi32(inverse, 16));
+
+        const __m128i destination = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + i));
+        const __m128i low = multiplyChannelsx2(_mm_unpacklo_epi8(destination, zero), _mm_unpacklo_epi32(inverse, inverse));
+        const __m128i high = multiplyChannelsx2(_mm_unpackhi_epi8(destination, zero), _mm_unpackhi_epi32(inverse, inverse));
+        const __m128i result = _mm_add_epi8(source, _mm_packus_epi16(low, high));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), result);
+    }
+    blendPremultipliedGeneric(dst + i, src + i, count - i);
+}
+
+TARGET_SSE2 void boxBlurColumns8Sse2(quint16 *dst, const quint16 *src, int count, int radius)
+{
+    const int width = 2 * radius + 1;
+    const __m128i inverse = _mm_set1_epi16(static_cast<short>((65536 + width / 2) / width));
+    const __m128i half = _mm_set1_epi16(static_cast<short>(width / 2));
+
+    __m128i sum = _mm_setzero_si128();
+    for (int y = 0; y < qMin(radius, count); ++y) {
+        sum = _mm_add_epi16(sum, _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + y * 8)));
+    }
+
+    for (int y = 0; y < count; ++y) {
+        if (y + radius < count) {
+            sum = _mm_add_epi16(sum, _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + (y + radius) * 8)));
+        }
+        const __m128i value = _mm_mulhi_epu16(_mm_add_epi16(sum, half), inverse);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + y * 8), value);
+        if (y - radius >= 0) {
+            sum = _mm_sub_epi16(sum, _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + (y - radius) * 8)));
+        }
+    }
+}
+
+// AVX2, eight pixels at a time
+
+TARGET_AVX2 void fillAlphaAvx2(quint32 *dst, const quint32 *src, int count)
+{
+    const __m256i alphaMask = _mm256_set1_epi32(static_cast<int>(0xff000000));
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_or_si256(pixels, alphaMask));
+    }
+    fillAlphaGeneric(dst + i, src + i, count - i);
+}
+
+TARGET_AVX2 void bgr30ToRgb32Avx2(quint32 *dst, const quint32 *src, int count)
+{
+    const __m256i alphaMask = _mm256_set1_epi32(static_cast<int>(0xff000000));
+    const __m256i redMask = _mm256_set1_epi32(0x00ff0000);
+    const __m256i greenMask = _mm256_set1_epi32(0x0000ff00);
+    const __m256i blueMask = _mm256_set1_epi32(0x000000ff);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        const __m256i red = _mm256_and_si256(_mm256_slli_epi32(pixels, 14), redMask);
+        const __m256i green = _mm256_and_si256(_mm256_srli_epi32(pixels, 4), greenMask);
+        const __m256i blue = _mm256_and_si256(_mm256_srli_epi32(pixels, 22), blueMask);
+        const __m256i result = _mm256_or_si256(_mm256_or_si256(alphaMask, red), _mm256_or_si256(green, blue));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), result);
+    }
+    bgr30ToRgb32Generic(dst + i, src + i, count - i);
+}
+
+TARGET_AVX2 void rgb16ToRgb32Avx2(quint32 *dst, const quint16 *src, int count)
+{
+    const __m256i alpha = _mm256_set1_epi32(static_cast<int>(0xff000000));
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i c = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)));
+        const __m256i blue = _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi32(c, 3), _mm256_set1_epi32(0x0000f8)),
+                                             _mm256_and_si256(_mm256_srli_epi32(c, 2), _mm256_set1_epi32(0x000007)));
+        const __m256i green = _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi32(c, 5), _mm256_set1_epi32(0x00fc00)),
+                                              _mm256_and_si256(_mm256_srli_epi32(c, 1), _mm256_set1_epi32(0x000300)));
+        const __m256i red = _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi32(c, 8), _mm256_set1_epi32(0xf80000)),
+                                            _mm256_and_si256(_mm256_slli_epi32(c, 3), _mm256_set1_epi32(0x070000)));
+        const __m256i result = _mm256_or_si256(_mm256_or_si256(alpha, red), _mm256_or_si256(green, blue));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), result);
+    }
+    rgb16ToRgb32Generic(dst + i, src + i, count - i);
+}
+
+TARGET_AVX2 inline __m256i unpremultiplyChannelx8(__m256i channel, __m256 scale)
+{
+    const __m256 value = _mm256_min_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(channel), scale), _mm256_set1_ps(255.0f));
+    return _mm256_cvtps_epi32(value);
+}
+
+TARGET_AVX2 void unpremultiplyAvx2(quint32 *dst, const quint32 *src, int count)
+{
+    const __m256i byteMask = _mm256_set1_epi32(0xff);
+    const __m256i zero = _mm256_setzero_si256();
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        const __m256i alpha = _mm256_srli_epi32(pixels, 24);
+
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(alpha, byteMask)) == -1) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), pixels);
+            continue;
+        }
+
+        const __m256 scale = _mm256_div_ps(_mm256_set1_ps(255.0f), _mm256_cvtepi32_ps(alpha));
+        const __m256i red = unpremultiplyChannelx8(_mm256_and_si256(_mm256_srli_epi32(pixels, 16), byteMask), scale);
+        const __m256i green = unpremultiplyChannelx8(_mm256_and_si256(_mm256_srli_epi32(pixels, 8), byteMask), scale);
+        const __m256i blue = unpremultiplyChannelx8(_mm256_and_si256(pixels, byteMask), scale);
+
+        __m256i result = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(alpha, 24), _mm256_slli_epi32(red, 16)),
+                                         _mm256_or_si256(_mm256_slli_epi32(green, 8), blue));
+        result = _mm256_andnot_si256(_mm256_cmpeq_epi32(alpha, zero), result);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), result);
+    }
+    unpremultiplyGeneric(dst + i, src + i, count - i);
+}
+
+#endif // PIXELKERNELS_X86
+
+// runtime dispatch
+
+struct KernelTable
+{
+    void (*fillAlpha)(quint32 *, const quint32 *, int);
+    void (*bgr30ToRgb32)(quint32 *, const quint32 *, int);
+    void (*rgb16ToRgb32)(quint32 *, const quint16 *, int);
+    void (*unpremultiply)(quint32 *, const quint32 *, int);
+    void (*blendPremultiplied)(quint32 *, const quint32 *, int);
+    void (*boxBlurColumns8)(quint16 *, const quint16 *, int, int);
+    const char *instructionSet;
+};
+
+KernelTable resolveKernels()
+{
+#ifdef PIXELKERNELS_X86
+    __builtin_cpu_init();
+    // blending only ever covers a cursor sized area, and eight columns of
+    // the blur fill exactly one SSE2 register. the SSE2 versions are used
+    // for those with AVX2 as well
+
+    if (__builtin_cpu_supports("avx2")) {
+        return { fillAlphaAvx2, bgr30ToRgb32Avx2, rgb16ToRgb32Avx2, unpremultiplyAvx2, blendPremultipliedSse2,
+                 boxBlurColumns8Sse2, "AVX2" };
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return { fillAlphaSse2, bgr30ToRgb32Sse2, rgb16ToRgb32Sse2, unpremultiplySse2, blendPremultipliedSse2,
+                 boxBlurColumns8Sse2, "SSE2" };
+    }
+#endif
+    return { fillAlphaGeneric, bgr30ToRgb32Generic, rgb16ToRgb32Generic, unpremultiplyGeneric, blendPremultipliedGeneric,
+             boxBlurColumns8Generic, "generic" };
+}
+
+const KernelTable &kernels()
+{
+    static const KernelTable table = resolveKernels();
+    return table;
+}
+
+} // namespace
+
+void PixelKernels::fillAlpha(quint32 *dst, const quint32 *src, int count)
+{
+    kernels().fillAlpha(dst, src, count);
+}
+
+void PixelKernels::bgr30ToRgb32(quint32 *dst, const quint32 *src, int count)
+{
+    kernels().bgr30ToRgb32(dst, src, count);
+}
+
+void PixelKernels::rgb16ToRgb32(quint32 *dst, const quint16 *src, int count)
+{
+    kernels().rgb16ToRgb32(dst, src, count);
+}
+
+void PixelKernels::unpremultiply(quint32 *dst, const quint32 *src, int count)
+{
+    kernels().unpremultiply(dst, src, count);
+}
+
+void PixelKernels::blendPremultiplied(quint32 *dst, const quint32 *src, int count)
+{
+    kernels().blendPremultiplied(dst, src, count);
+}
+
+void PixelKernels::boxBlurColumns8(quint16 *dst, const quint16 *src, int count, int radius)
+{
+    kernels().boxBlurColumns8(dst, src, count, radius);
+}
+
+const char *PixelKernels::instructionSet()
+{
+    return kernels().instructionSet;
+}
@@ -0,0 +1,75 @@
+/*
+ *  Copyright (C) 2019 The Spectacle Developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#ifndef PIXELKERNELS_H
+#define PIXELKERNELS_H
+
+#include <QtGlobal>
+
+// Row-oriented pixel conversion kernels. Each kernel reads count pixels
+// from src and writes the converted pixels to dst, so that a fix-up can be
+// fused with the copy into the destination buffer and every pixel is touched
+// exactly once. Unless noted otherwise, dst may point to the same memory as
+// src to convert a row in place.
+//
+// The SSE2 or AVX2 implementation is picked at runtime depending on what
+// the CPU supports, with a plain C++ fallback for everything else.
+
+namespace PixelKernels
+{
+    // 0x??RRGGBB -> 0xffRRGGBB, as required by QImage::Format_RGB32
+    void fillAlpha(quint32 *dst, const quint32 *src, int count);
+
+    // QImage::Format_BGR30 (x:2 b:10 g:10 r:10) -> QImage::Format_RGB32
+    void bgr30ToRgb32(quint32 *dst, const quint32 *src, int count);
+
+    // QImage::Format_RGB16 -> QImage::Format_RGB32. Can't be done in place.
+    void rgb16ToRgb32(quint32 *dst, const quint16 *src, int count);
+
+    // QImage::Format_ARGB32_Premultiplied -> QImage::Format_ARGB32
+    void unpremultiply(quint32 *dst, const quint32 *src, int count);
+
+    // composites premultiplied src over dst, in place. dst can be
+    // QImage::Format_ARGB32_Premultiplied or QImage::Format_RGB32
+    void blendPremultiplied(quint32 *dst, const quint32 *src, int count);
+
+    // one box blur pass down eight adjacent columns. src and dst hold count
+    // rows of eight 16-bit values, everything above and below counts as
+    // zero. the sums of a box must fit into 16 bits. Can't be done in place.
+    void boxBlurColumns8(quint16 *dst, const quint16 *src, int count, int radius);
+
+    // name of the instruction set the kernels were resolved to, for debugging
+    const char *instructionSet();
+
+    // multiplies all four channels of a premultiplied pixel with a / 255,
+    // with rounding
+    inline quint32 multiplyPixel(quint32 x, uint a)
+    {
+        quint32 t = (x & 0xff00ff) * a;
+        t = (t + ((t >> 8) & 0xff00ff) + 0x800080) >> 8;
+        t &= 0xff00ff;
+
+        x = ((x >> 8) & 0xff00ff) * a;
+        x = (x + ((x >> 8) & 0xff00ff) + 0x800080);
+        x &= 0xff00ff00;
+        return x | t;
+    }
+}
+
+#endif // PIXELKERNELS_H
@@ -0,0 +1,299 @@
+/*
+ *  Copyright (C) 2019 The Spectacle Developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "ShadowGenerator.h"
+#include "PixelKernels.h"
+
+#include <QtConcurrentMap>
+#include <QtMath>
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+// the blur works on bands of this many rows or columns at a time, which
+// are handed out to the thread pool
+
+static const int ROW_BAND = 32;
+static const int COLUMN_BAND = 64;
+
+// the number of box blur passes. three passes are within a few percent
+// of a real Gaussian
+
+static const int BOX_PASSES = 3;
+
+// the sums of a box have to fit into 16 bits for the column pass
+
+static const int MAX_BOX_RADIUS = 127;
+
+namespace {
+
+// One box blur pass over a line of count values. Everything outside the
+// line counts as zero. Dividing by the box width is done as a fixed point
+// multiplication, the same way the column kernel does it.
+void boxBlurLine(const quint8 *src, quint8 *dst, int count, int radius)
+{
+    const uint width = 2 * radius + 1;
+    const uint inverse = (65536 + width / 2) / width;
+    const uint half = width / 2;
+
+    uint sum = 0;
+    for (int i = 0; i < qMin(radius, count); ++i) {
+        sum += src[i];
+    }
+
+    for (int i = 0; i < count; ++i) {
+        if (i + radius < count) {
+            sum += src[i + radius];
+        }
+        dst[i] = static_cast<quint8>(((sum + half) * inverse) >> 16);
+        if (i - radius >= 0) {
+            sum -= src[i - radius];
+        }
+    }
+}
+
+// runs all passes over a line, using scratch as the second buffer
+void blurLine(quint8 *line, quint8 *scratch, int count, const QVector<int> &radii)
+{
+    quint8 *src = line;
+    quint8 *dst = scratch;
+    for (int radius : radii) {
+        boxBlurLine(src, dst, count, radius);
+        std::swap(src, dst);
+    }
+    if (src != line) {
+        memcpy(line, src, count);
+    }
+}
+
+void blurRows(quint8 *mask, int stride, int width, int firstRow, int lastRow, const QVector<int> &radii)
+{
+    QVector<quint8> scratch(width);
+    for (int y = firstRow; y < lastRow; ++y) {
+        blurLine(mask + y * stride, scratch.data(), width, radii);
+    }
+}
+
+// columns are copied into a contiguous line, blurred and copied back
+void blurColumnsGeneric(quint8 *mask, int stride, int height, int firstColumn, int lastColumn, const QVector<int> &radii)
+{
+    QVector<quint8> line(height);
+    QVector<quint8> scratch(height);
+    for (int x = firstColumn; x < lastColumn; ++x) {
+        for (int y = 0; y < height; ++y) {
+            line[y] = mask[y * stride + x];
+        }
+        blurLine(line.data(), scratch.data(), height, radii);
+        for (int y = 0; y < height; ++y) {
+            mask[y * stride + x] = line[y];
+        }
+    }
+}
+
+// eight columns at a time go through the box blur kernel as 16-bit
+// values, the ones left over at the end are blurred one by one
+void blurColumns(quint8 *mask, int stride, int height, int firstColumn, int lastColumn, const QVector<int> &radii)
+{
+    QVector<quint16> bufferA(height * 8);
+    QVector<quint16> bufferB(height * 8);
+
+    int x = firstColumn;
+    for (; x + 8 <= lastColumn; x += 8) {
+        for (int y = 0; y < height; ++y) {
+            std::copy(mask + y * stride + x, mask + y * stride + x + 8, bufferA.data() + y * 8);
+        }
+
+        quint16 *src = bufferA.data();
+        quint16 *dst = bufferB.data();
+        for (int radius : radii) {
+            PixelKernels::boxBlurColumns8(dst, src, height, radius);
+            std::swap(src, dst);
+        }
+
+        for (int y = 0; y < height; ++y) {
+            std::copy(src + y * 8, src + y * 8 + 8, mask + y * stride + x);
+        }
+    }
+
+    blurColumnsGeneric(mask, stride, height, x, lastColumn, radii);
+}
+
+} // namespace
+
+ShadowGenerator::ShadowGenerator(int radius, const QPoint &offset, const QColor &color) :
+    mRadius(qMax(0, radius)),
+    mOffset(offset),
+    mColor(color)
+{
+}
+
+int ShadowGenerator::radius() const
+{
+    return mRadius;
+}
+
+void ShadowGenerator::setRadius(int radius)
+{
+    mRadius = qMax(0, radius);
+}
+
+QPoint ShadowGenerator::offset() const
+{
+    return mOffset;
+}
+
+void ShadowGenerator::setOffset(const QPoint &offset)
+{
+    mOffset = offset;
+}
+
+QColor ShadowGenerator::color() const
+{
+    return mColor;
+}
+
+void ShadowGenerator::setColor(const QColor &color)
+{
+    mColor = color;
+}
+
+QVector<int> ShadowGenerator::boxRadii() const
+{
+    // box widths whose combined variance matches a Gaussian. a sigma of a
+    // third of the radius makes the shadow fade out at about the radius
+
+    QVector<int> radii;
+    if (mRadius == 0) {
+        return radii;
+    }
+
+    const qreal sigma = mRadius / 3.0;
+    const qreal idealWidth = qSqrt(12.0 * sigma * sigma / BOX_PASSES + 1.0);
+    int lowerWidth = qFloor(idealWidth);
+    if (lowerWidth % 2 == 0) {
+        lowerWidth--;
+    }
+    const int upperWidth = lowerWidth + 2;
+    const qreal idealLowerCount = (12.0 * sigma * sigma - BOX_PASSES * lowerWidth * lowerWidth - 4.0 * BOX_PASSES * lowerWidth - 3.0 * BOX_PASSES)
+                                / (-4.0 * lowerWidth - 4.0);
+    const int lowerCount = qRound(idealLowerCount);
+
+    for (int i = 0; i < BOX_PASSES; ++i) {
+        const int radius = qMin(((i < lowerCount ? lowerWidth : upperWidth) - 1) / 2, MAX_BOX_RADIUS);
+        if (radius > 0) {
+            radii.append(radius);
+        }
+    }
+    return radii;
+}
+
+QMargins ShadowGenerator::margins() const
+{
+    const QVector<int> radii = boxRadii();
+    const int extent = std::accumulate(radii.cbegin(), radii.cend(), 0);
+
+    return QMargins(qMax(0, extent - mOffset.x()), qMax(0, extent - mOffset.y()),
+                    qMax(0, extent + mOffset.x()), qMax(0, extent + mOffset.y()));
+}
+
+QImage ShadowGenerator::apply(const QImage &image) const
+{
+    const QImage source = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    const QMargins shadowMargins = margins();
+    const int width = source.width() + shadowMargins.left() + shadowMargins.right();
+    const int height = source.height() + shadowMargins.top() + shadowMargins.bottom();
+
+    QImage result(width, height, QImage::Format_ARGB32_Premultiplied);
+    if (source.isNull() || result.isNull()) {
+        return QImage();
+    }
+
+    // the shadow mask is the alpha channel of the image, moved by the offset
+
+    const int stride = width;
+    QVector<quint8> mask(stride * height, 0);
+    const QPoint maskOrigin(shadowMargins.left() + mOffset.x(), shadowMargins.top() + mOffset.y());
+    for (int y = 0; y < source.height(); ++y) {
+        const quint32 *sourceRow = reinterpret_cast<const quint32 *>(source.constScanLine(y));
+        quint8 *maskRow = mask.data() + (maskOrigin.y() + y) * stride + maskOrigin.x();
+        for (int x = 0; x < source.width(); ++x) {
+            maskRow[x] = static_cast<quint8>(qAlpha(sourceRow[x]));
+        }
+    }
+
+    // blur the mask, all rows first and then all columns. the bands of
+    // each direction are independent of each other
+
+    const QVector<int> radii = boxRadii();
+    quint8 *maskData = mask.data();
+    if (!radii.isEmpty()) {
+        QVector<int> rowBands;
+        for (int y = 0; y < height; y += ROW_BAND) {
+            rowBands.append(y);
+        }
+        QtConcurrent::blockingMap(rowBands, [=](int &firstRow) {
+            blurRows(maskData, stride, width, firstRow, qMin(firstRow + ROW_BAND, height), radii);
+        });
+
+        QVector<int> columnBands;
+        for (int x = 0; x < width; x += COLUMN_BAND) {
+            columnBands.append(x);
+        }
+        QtConcurrent::blockingMap(columnBands, [=](int &firstColumn) {
+            blurColumns(maskData, stride, height, firstColumn, qMin(firstColumn + COLUMN_BAND, width), radii);
+        });
+    }
+
+    // composite the image over the tinted mask in one go
+
+    const quint32 shadowColor = qPremultiply(mColor.rgba());
+    uchar *resultBits = result.bits();
+    const int resultStride = result.bytesPerLine();
+
+    QVector<int> compositeBands;
+    for (int y = 0; y < height; y += ROW_BAND) {
+        compositeBands.append(y);
+    }
+    QtConcurrent::blockingMap(compositeBands, [=, &source](int &firstRow) {
+        const int lastRow = qMin(firstRow + ROW_BAND, height);
+        for (int y = firstRow; y < lastRow; ++y) {
+            quint32 *resultRow = reinterpret_cast<quint32 *>(resultBits + y * resultStride);
+            const quint8 *maskRow = maskData + y * stride;
+
+            for (int x = 0; x < width; ++x) {
+                resultRow[x] = PixelKernels::multiplyPixel(shadowColor, maskRow[x]);
+            }
+
+            const int sourceY = y - shadowMargins.top();
+            if (sourceY < 0 || sourceY >= source.height()) {
+                continue;
+            }
+
+            const quint32 *sourceRow = reinterpret_cast<const quint32 *>(source.constScanLine(sourceY));
+            quint32 *row = resultRow + shadowMargins.left();
+            for (int x = 0; x < source.width(); ++x) {
+                const quint32 pixel = sourceRow[x];
+                row[x] = pixel + PixelKernels::multiplyPixel(row[x], 255 - qAlpha(pixel));
+            }
+        }
+    });
+
+    return result;
+}
@@ -0,0 +1,67 @@
+/*
+ *  Copyright (C) 2019 The Spectacle Developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#ifndef SHADOWGENERATOR_H
+#define SHADOWGENERATOR_H
+
+#include <QColor>
+#include <QImage>
+#include <QMargins>
+#include <QPoint>
+#include <QVector>
+
+// Renders a drop shadow below an image with an alpha channel.
+//
+// The alpha channel of the image is used as the shadow mask, which is
+// blurred with three box blur passes in each direction. That's a close
+// approximation of a Gaussian blur whose cost doesn't depend on the radius.
+// The blur is split into bands that are processed on the global thread
+// pool, and the shadow and the image are composited in a single pass.
+
+class ShadowGenerator
+{
+    public:
+
+    explicit ShadowGenerator(int radius = 20, const QPoint &offset = QPoint(), const QColor &color = QColor(63, 63, 63, 180));
+
+    int radius() const;
+    void setRadius(int radius);
+
+    QPoint offset() const;
+    void setOffset(const QPoint &offset);
+
+    QColor color() const;
+    void setColor(const QColor &color);
+
+    // how far the result of apply() extends beyond the source image
+    QMargins margins() const;
+
+    // returns the image on top of its shadow, as ARGB32_Premultiplied
+    QImage apply(const QImage &image) const;
+
+    private:
+
+    QVector<int> boxRadii() const;
+
+    int    mRadius;
+    QPoint mOffset;
+    QColor mColor;
+};
+
+#endif // SHADOWGENERATOR_H
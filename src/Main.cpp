@@ -20,6 +20,7 @@
 #include "Config.h"
 #include "SpectacleCore.h"
 #include "SpectacleDBusAdapter.h"
+#include "spectacle_core_debug.h"
 
 #include <KAboutData>
 #include <KDBusService>
@@ -58,17 +59,21 @@ int main(int argc, char **argv)
     parser.addOptions({
         {{QStringLiteral("f"), QStringLiteral("fullscreen")},        i18n("Capture the entire desktop (default)")},
         {{QStringLiteral("m"), QStringLiteral("current")},           i18n("Capture the current monitor")},
+        {QStringLiteral("screen"),                                   i18n("Capture the monitor connected to the named output, like HDMI-1. Implies --current"), QStringLiteral("name")},
         {{QStringLiteral("a"), QStringLiteral("activewindow")},      i18n("Capture the active window")},
         {{QStringLiteral("u"), QStringLiteral("windowundercursor")}, i18n("Capture the window currently under the cursor, including parents of pop-up menus")},
         {{QStringLiteral("t"), QStringLiteral("transientonly")},     i18n("Capture the window currently under the cursor, excluding parents of pop-up menus")},
         {{QStringLiteral("r"), QStringLiteral("region")},            i18n("Capture a rectangular region of the screen")},
+        {QStringLiteral("allwindows"),                               i18n("Capture every window into an image of its own, saved to a new folder. Implies background mode, use --output to choose the folder")},
         {{QStringLiteral("g"), QStringLiteral("gui")},               i18n("Start in GUI mode (default)")},
         {{QStringLiteral("b"), QStringLiteral("background")},        i18n("Take a screenshot and exit without showing the GUI")},
         {{QStringLiteral("s"), QStringLiteral("dbus")},              i18n("Start in DBus-Activation mode")},
         {{QStringLiteral("n"), QStringLiteral("nonotify")},          i18n("In background mode, do not pop up a notification when the screenshot is taken")},
         {{QStringLiteral("o"), QStringLiteral("output")},            i18n("In background mode, save image to specified file"), QStringLiteral("fileName")},
         {{QStringLiteral("d"), QStringLiteral("delay")},             i18n("In background mode, delay before taking the shot (in milliseconds)"), QStringLiteral("delayMsec")},
-        {{QStringLiteral("w"), QStringLiteral("onclick")},           i18n("Wait for a click before taking screenshot. Invalidates delay")}
+        {{QStringLiteral("w"), QStringLiteral("onclick")},           i18n("Wait for a click before taking screenshot. Invalidates delay")},
+        {QStringLiteral("stream"),                                   i18n("In background mode, write the screenshot to disk while it is being taken to save memory. Only supported for full screen PNG images")},
+        {QStringLiteral("encoding"),                                 i18n("How saved images are encoded: \"fast\" for speed or \"archival\" for a small file. Overrides the configured profile"), QStringLiteral("profile")}
     });
 
     parser.process(app);
@@ -77,7 +82,11 @@ int main(int argc, char **argv)
     // extract the capture mode
 
     ImageGrabber::GrabMode grabMode = ImageGrabber::FullScreen;
-    if (parser.isSet(QStringLiteral("current"))) {
+    QString screenName;
+    if (parser.isSet(QStringLiteral("screen"))) {
+        grabMode = ImageGrabber::CurrentScreen;
+        screenName = parser.value(QStringLiteral("screen"));
+    } else if (parser.isSet(QStringLiteral("current"))) {
         grabMode = ImageGrabber::CurrentScreen;
     } else if (parser.isSet(QStringLiteral("activewindow"))) {
         grabMode = ImageGrabber::ActiveWindow;
@@ -87,12 +96,28 @@ int main(int argc, char **argv)
         grabMode = ImageGrabber::TransientWithParent;
     } else if (parser.isSet(QStringLiteral("transientonly"))) {
         grabMode = ImageGrabber::WindowUnderCursor;
+    } else if (parser.isSet(QStringLiteral("allwindows"))) {
+        grabMode = ImageGrabber::AllWindows;
+    }
+
+    // the encoding profile for saved screenshots
+
+    if (parser.isSet(QStringLiteral("encoding"))) {
+        const QString profile = parser.value(QStringLiteral("encoding"));
+        if (profile == QLatin1String("fast")) {
+            ExportManager::instance()->setEncodingProfile(EncodingProfile::Fast);
+        } else if (profile == QLatin1String("archival")) {
+            ExportManager::instance()->setEncodingProfile(EncodingProfile::Archival);
+        } else {
+            qCWarning(SPECTACLE_CORE_LOG) << "Unknown encoding profile" << profile << "- expected fast or archival";
+        }
     }
 
     // are we running in background or dbus mode?
 
     SpectacleCore::StartMode startMode = SpectacleCore::GuiMode;
     bool notify = true;
+    bool streamGrab = false;
     qint64 delayMsec = 0;
     QString fileName = QString();
 
@@ -100,6 +125,9 @@ int main(int argc, char **argv)
         startMode = SpectacleCore::BackgroundMode;
     } else if (parser.isSet(QStringLiteral("dbus"))) {
         startMode = SpectacleCore::DBusMode;
+    } else if (grabMode == ImageGrabber::AllWindows) {
+        // the GUI can only show a single screenshot
+        startMode = SpectacleCore::BackgroundMode;
     }
 
     switch (startMode) {
@@ -124,6 +152,10 @@ int main(int argc, char **argv)
             delayMsec = -1;
         }
 
+        if (parser.isSet(QStringLiteral("stream"))) {
+            streamGrab = true;
+        }
+
         app.setQuitOnLastWindowClosed(false);
         break;
 
@@ -137,7 +169,7 @@ int main(int argc, char **argv)
 
     // release the kraken
 
-    SpectacleCore core(startMode, grabMode, fileName, delayMsec, notify);
+    SpectacleCore core(startMode, grabMode, fileName, delayMsec, notify, streamGrab, screenName);
     QObject::connect(&core, &SpectacleCore::allDone, qApp, &QApplication::quit);
 
     // create the dbus connections
@@ -155,5 +187,9 @@ int main(int argc, char **argv)
 
     // fire it up
 
-    return app.exec();
+    const int result = app.exec();
+
+    // don't leave before every screenshot is on disk
+    ExportManager::instance()->waitForPendingSaves();
+    return result;
 }
@@ -31,42 +31,41 @@ bool DummyImageGrabber::onClickGrabSupported() const
     return false;
 }
 
-QPixmap DummyImageGrabber::blendCursorImage(const QPixmap &pixmap, int x, int y, int width, int height)
+void DummyImageGrabber::blendCursorImage(QImage &image, int x, int y, int width, int height)
 {
-    Q_UNUSED(pixmap);
+    Q_UNUSED(image);
     Q_UNUSED(x);
     Q_UNUSED(y);
     Q_UNUSED(width);
     Q_UNUSED(height);
-    return QPixmap();
 }
 
 void DummyImageGrabber::grabFullScreen()
 {
-    emit pixmapChanged(QPixmap());
+    emit imageChanged(QImage());
 }
 
 void DummyImageGrabber::grabCurrentScreen()
 {
-    emit pixmapChanged(QPixmap());
+    emit imageChanged(QImage());
 }
 
 void DummyImageGrabber::grabActiveWindow()
 {
-    emit pixmapChanged(QPixmap());
+    emit imageChanged(QImage());
 }
 
 void DummyImageGrabber::grabRectangularRegion()
 {
-    emit pixmapChanged(QPixmap());
+    emit imageChanged(QImage());
 }
 
 void DummyImageGrabber::grabWindowUnderCursor()
 {
-    emit pixmapChanged(QPixmap());
+    emit imageChanged(QImage());
 }
 
 void DummyImageGrabber::grabTransientWithParent()
 {
-    emit pixmapChanged(QPixmap());
+    emit imageChanged(QImage());
 }
@@ -21,7 +21,7 @@
 #define DUMMYIMAGEGRABBER_H
 
 #include <QObject>
-#include <QPixmap>
+#include <QImage>
 
 #include "ImageGrabber.h"
 
@@ -39,7 +39,7 @@ class DummyImageGrabber : public ImageGrabber
 
     protected:
 
-    QPixmap blendCursorImage(const QPixmap &pixmap, int x, int y, int width, int height) override;
+    void blendCursorImage(QImage &image, int x, int y, int width, int height) override;
     void grabFullScreen()          override;
     void grabCurrentScreen()       override;
     void grabActiveWindow()        override;
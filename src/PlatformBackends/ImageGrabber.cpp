@@ -24,7 +24,7 @@ ImageGrabber::ImageGrabber(QObject *parent) :
     mCapturePointer(false),
     mCaptureDecorations(true),
     mGrabMode(InvalidChoice),
-    mPixmap(QPixmap())
+    mImage(QImage())
 {
 }
 
@@ -39,11 +39,27 @@ bool ImageGrabber::onClickGrabSupported() const
     return false;
 }
 
+bool ImageGrabber::streamGrabSupported() const
+{
+    return false;
+}
+
+bool ImageGrabber::doStreamGrab(ImageStreamSink *sink)
+{
+    Q_UNUSED(sink);
+    return false;
+}
+
+void ImageGrabber::grabAllWindows()
+{
+    emit imageGrabFailed();
+}
+
 // Q_PROPERTY Stuff
 
-QPixmap ImageGrabber::pixmap() const
+QImage ImageGrabber::image() const
 {
-    return mPixmap;
+    return mImage;
 }
 
 bool ImageGrabber::capturePointer() const
@@ -61,6 +77,11 @@ ImageGrabber::GrabMode ImageGrabber::grabMode() const
     return mGrabMode;
 }
 
+QString ImageGrabber::screenName() const
+{
+    return mScreenName;
+}
+
 void ImageGrabber::setCapturePointer(const bool newCapturePointer)
 {
     mCapturePointer = newCapturePointer;
@@ -76,6 +97,11 @@ void ImageGrabber::setGrabMode(const GrabMode newGrabMode)
     mGrabMode = newGrabMode;
 }
 
+void ImageGrabber::setScreenName(const QString &newScreenName)
+{
+    mScreenName = newScreenName;
+}
+
 // Slots
 
 void ImageGrabber::doOnClickGrab()
@@ -104,6 +130,9 @@ void ImageGrabber::doImageGrab()
     case RectangularRegion:
         grabRectangularRegion();
         break;
+    case AllWindows:
+        grabAllWindows();
+        break;
     case InvalidChoice:
     default:
         emit imageGrabFailed();
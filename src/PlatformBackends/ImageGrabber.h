@@ -22,18 +22,20 @@
 
 #include <QObject>
 #include <QList>
-#include <QPixmap>
+#include <QImage>
+#include <QVector>
 #include <QScreen>
 #include <QDesktopWidget>
 #include <QApplication>
 
 #include "QuickEditor/QuickEditor.h"
+#include "ImageStreamSink.h"
 
 class ImageGrabber : public QObject
 {
     Q_OBJECT
 
-    Q_PROPERTY(QPixmap pixmap READ pixmap NOTIFY pixmapChanged)
+    Q_PROPERTY(QImage image READ image NOTIFY imageChanged)
     Q_PROPERTY(bool capturePointer READ capturePointer WRITE setCapturePointer NOTIFY capturePointerChanged)
     Q_PROPERTY(bool captureDecorations READ captureDecorations WRITE setCaptureDecorations NOTIFY captureDecorationsChanged)
     Q_PROPERTY(GrabMode grabMode READ grabMode WRITE setGrabMode NOTIFY grabModeChanged)
@@ -47,29 +49,49 @@ class ImageGrabber : public QObject
         ActiveWindow        = 2,
         WindowUnderCursor   = 3,
         TransientWithParent = 4,
-        RectangularRegion   = 5
+        RectangularRegion   = 5,
+        AllWindows          = 6
     };
 
     Q_ENUM(GrabMode)
 
+    // one of the images taken in the AllWindows grab mode
+    struct WindowImage
+    {
+        QString title;
+        QImage  image;
+    };
+
     explicit ImageGrabber(QObject *parent = nullptr);
     ~ImageGrabber();
 
-    QPixmap pixmap() const;
+    QImage image() const;
     bool capturePointer() const;
     bool captureDecorations() const;
     GrabMode grabMode() const;
+    QString screenName() const;
 
     virtual QVector<GrabMode> supportedModes() const = 0;
     virtual bool onClickGrabSupported() const;
+    virtual bool streamGrabSupported() const;
+
+    // Captures the full screen synchronously and hands it to the sink in
+    // bands, instead of emitting imageChanged(). Only the FullScreen grab
+    // mode can be streamed.
+    virtual bool doStreamGrab(ImageStreamSink *sink);
 
     void setCapturePointer(const bool newCapturePointer);
     void setCaptureDecorations(const bool newCaptureDecorations);
     void setGrabMode(const GrabMode newGrabMode);
 
+    // the output captured in the CurrentScreen grab mode. when empty, the
+    // output below the mouse pointer is used
+    void setScreenName(const QString &newScreenName);
+
     Q_SIGNALS:
 
-    void pixmapChanged(const QPixmap &pixmap);
+    void imageChanged(const QImage &image);
+    void windowImagesChanged(const QVector<ImageGrabber::WindowImage> &images);
     void windowTitleChanged(const QString &windowTitle);
     void imageGrabFailed();
     void capturePointerChanged(bool capturePointer);
@@ -89,12 +111,14 @@ class ImageGrabber : public QObject
     virtual void grabRectangularRegion() = 0;
     virtual void grabWindowUnderCursor() = 0;
     virtual void grabTransientWithParent() = 0;
-    virtual QPixmap blendCursorImage(const QPixmap &pixmap, int x, int y, int width, int height) = 0;
+    virtual void grabAllWindows();
+    virtual void blendCursorImage(QImage &image, int x, int y, int width, int height) = 0;
 
     bool     mCapturePointer;
     bool     mCaptureDecorations;
     GrabMode mGrabMode;
-    QPixmap  mPixmap;
+    QString  mScreenName;
+    QImage   mImage;
 };
 
 #endif // IMAGEGRABBER_H
@@ -0,0 +1,42 @@
+/*
+ *  Copyright (C) 2019 The Spectacle Developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#ifndef IMAGESTREAMSINK_H
+#define IMAGESTREAMSINK_H
+
+#include <QImage>
+#include <QSize>
+
+// Receives a screenshot as a sequence of horizontal bands, top to bottom,
+// so that the whole image never has to be held in memory at once. Every
+// band spans the full width of the image. If any call returns false, the
+// grabber aborts and doesn't call the sink again.
+
+class ImageStreamSink
+{
+    public:
+
+    virtual ~ImageStreamSink() = default;
+
+    virtual bool beginImage(const QSize &size) = 0;
+    virtual bool writeBand(const QImage &band) = 0;
+    virtual bool finishImage() = 0;
+};
+
+#endif // IMAGESTREAMSINK_H
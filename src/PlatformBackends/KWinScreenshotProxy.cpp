@@ -0,0 +1,165 @@
+/*
+ *  Copyright (C) 2019 The Spectacle Developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "KWinScreenshotProxy.h"
+#include "spectacle_capture_debug.h"
+#include "kwineffects_interface.h"
+#include "kwinscreenshot_interface.h"
+#include "kwinscreenshot2_interface.h"
+
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QDBusServiceWatcher>
+
+static const QString KWIN_SERVICE = QStringLiteral("org.kde.KWin");
+static const QString SCREENSHOT2_PATH = QStringLiteral("/org/kde/KWin/ScreenShot2");
+
+KWinScreenshotProxy::KWinScreenshotProxy(QObject *parent) :
+    QObject(parent),
+    mState{State::Unknown, State::Unknown},
+    mPendingQuery{nullptr, nullptr}
+{
+    // generated proxies, unlike QDBusInterface, don't introspect the remote
+    // object when they are created
+
+    const QDBusConnection bus = QDBusConnection::sessionBus();
+    mEffects = new OrgKdeKwinEffectsInterface(KWIN_SERVICE, QStringLiteral("/Effects"), bus, this);
+    mScreenshot = new OrgKdeKwinScreenshotInterface(KWIN_SERVICE, QStringLiteral("/Screenshot"), bus, this);
+    mScreenShot2 = new OrgKdeKWinScreenShot2Interface(KWIN_SERVICE, SCREENSHOT2_PATH, bus, this);
+
+    mServiceWatcher = new QDBusServiceWatcher(KWIN_SERVICE, bus, QDBusServiceWatcher::WatchForOwnerChange, this);
+    connect(mServiceWatcher, &QDBusServiceWatcher::serviceOwnerChanged, this, &KWinScreenshotProxy::serviceOwnerChanged);
+
+    queryAvailability(Screenshot);
+    queryAvailability(ScreenShot2);
+}
+
+KWinScreenshotProxy::~KWinScreenshotProxy()
+{
+}
+
+bool KWinScreenshotProxy::isAvailable(Interface interface)
+{
+    if (mState[interface] == State::Unknown) {
+        queryAvailability(interface);
+    }
+
+    // only the first capture after a change in KWin ever waits here.
+    // waitForFinished() delivers the finished() signal before it returns,
+    // so the reply has usually been handled by then already
+
+    if (mState[interface] == State::Pending) {
+        QDBusPendingCallWatcher *watcher = mPendingQuery[interface];
+        watcher->waitForFinished();
+        if (mPendingQuery[interface] == watcher) {
+            availabilityQueried(watcher);
+        }
+    }
+
+    return mState[interface] == State::Available;
+}
+
+OrgKdeKwinScreenshotInterface *KWinScreenshotProxy::screenshot() const
+{
+    return mScreenshot;
+}
+
+OrgKdeKWinScreenShot2Interface *KWinScreenshotProxy::screenShot2() const
+{
+    return mScreenShot2;
+}
+
+void KWinScreenshotProxy::invalidate(Interface interface)
+{
+    if (mState[interface] != State::Pending) {
+        mState[interface] = State::Unknown;
+    }
+}
+
+void KWinScreenshotProxy::queryAvailability(Interface interface)
+{
+    // a call to a service that isn't there fails right away, so there is
+    // no need to ask the bus whether KWin is registered first
+
+    QDBusPendingCall call = mEffects->isEffectLoaded(QStringLiteral("screenshot"));
+    if (interface == ScreenShot2) {
+        // reading the property through the generated proxy would block
+        QDBusMessage message = QDBusMessage::createMethodCall(KWIN_SERVICE, SCREENSHOT2_PATH,
+                                                              QStringLiteral("org.freedesktop.DBus.Properties"),
+                                                              QStringLiteral("Get"));
+        message << OrgKdeKWinScreenShot2Interface::staticInterfaceName() << QStringLiteral("Version");
+        call = QDBusConnection::sessionBus().asyncCall(message);
+    }
+
+    mState[interface] = State::Pending;
+    mPendingQuery[interface] = new QDBusPendingCallWatcher(call, this);
+    connect(mPendingQuery[interface], &QDBusPendingCallWatcher::finished, this, &KWinScreenshotProxy::availabilityQueried);
+}
+
+void KWinScreenshotProxy::availabilityQueried(QDBusPendingCallWatcher *watcher)
+{
+    if (!watcher) {
+        return;
+    }
+
+    // the watcher of a query that was replaced by a newer one is dropped
+
+    Interface interface;
+    if (watcher == mPendingQuery[Screenshot]) {
+        interface = Screenshot;
+    } else if (watcher == mPendingQuery[ScreenShot2]) {
+        interface = ScreenShot2;
+    } else {
+        watcher->deleteLater();
+        return;
+    }
+
+    bool available = false;
+    if (interface == Screenshot) {
+        QDBusPendingReply<bool> reply = *watcher;
+        available = !reply.isError() && reply.value();
+    } else {
+        // any version will do, it's only an error if the interface is missing
+        available = !watcher->isError();
+    }
+
+    mState[interface] = available ? State::Available : State::Unavailable;
+    mPendingQuery[interface] = nullptr;
+    watcher->deleteLater();
+
+    qCDebug(SPECTACLE_CAPTURE_LOG) << "KWin screenshot interface" << interface << "available:" << available;
+}
+
+void KWinScreenshotProxy::serviceOwnerChanged(const QString &service, const QString &oldOwner, const QString &newOwner)
+{
+    Q_UNUSED(service);
+    Q_UNUSED(oldOwner);
+
+    for (Interface interface : {Screenshot, ScreenShot2}) {
+        if (newOwner.isEmpty()) {
+            mPendingQuery[interface] = nullptr;
+            mState[interface] = State::Unavailable;
+        } else {
+            // KWin was restarted or replaced, the effect has to be looked up again
+            queryAvailability(interface);
+        }
+    }
+}
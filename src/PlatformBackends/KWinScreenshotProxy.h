@@ -0,0 +1,85 @@
+/*
+ *  Copyright (C) 2019 The Spectacle Developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#ifndef KWINSCREENSHOTPROXY_H
+#define KWINSCREENSHOTPROXY_H
+
+#include <QObject>
+
+class QDBusPendingCallWatcher;
+class QDBusServiceWatcher;
+class OrgKdeKWinScreenShot2Interface;
+class OrgKdeKwinEffectsInterface;
+class OrgKdeKwinScreenshotInterface;
+
+// Long lived proxies for KWin's screenshot interfaces.
+//
+// Whether the screenshot effect is loaded, and whether it offers the newer
+// ScreenShot2 interface, is asked once without blocking when the proxy is
+// created and again whenever KWin changes its owner on the session bus.
+// Captures only read the cached answers, unless they come in before the
+// first replies did.
+
+class KWinScreenshotProxy : public QObject
+{
+    Q_OBJECT
+
+    public:
+
+    enum Interface {
+        Screenshot  = 0,   // org.kde.kwin.Screenshot, returns X11 pixmaps or writes to a pipe
+        ScreenShot2 = 1    // org.kde.KWin.ScreenShot2, writes raw image data to a pipe
+    };
+
+    explicit KWinScreenshotProxy(QObject *parent = nullptr);
+    ~KWinScreenshotProxy() override;
+
+    bool isAvailable(Interface interface = Screenshot);
+    OrgKdeKwinScreenshotInterface *screenshot() const;
+    OrgKdeKWinScreenShot2Interface *screenShot2() const;
+
+    // to be called when a call on an interface failed, for example because
+    // the effect was unloaded in the meantime
+    void invalidate(Interface interface = Screenshot);
+
+    private Q_SLOTS:
+
+    void serviceOwnerChanged(const QString &service, const QString &oldOwner, const QString &newOwner);
+    void availabilityQueried(QDBusPendingCallWatcher *watcher);
+
+    private:
+
+    enum class State {
+        Unknown,
+        Pending,
+        Available,
+        Unavailable
+    };
+
+    void queryAvailability(Interface interface);
+
+    State                           mState[2];
+    QDBusPendingCallWatcher        *mPendingQuery[2];
+    QDBusServiceWatcher            *mServiceWatcher;
+    OrgKdeKwinEffectsInterface     *mEffects;
+    OrgKdeKwinScreenshotInterface  *mScreenshot;
+    OrgKdeKWinScreenShot2Interface *mScreenShot2;
+};
+
+#endif // KWINSCREENSHOTPROXY_H
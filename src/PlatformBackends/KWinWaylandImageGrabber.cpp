@@ -17,59 +17,70 @@
  *  Boston, MA 02110-1301, USA.
  */
 #include "KWinWaylandImageGrabber.h"
+#include "KWinScreenshotProxy.h"
+#include "spectacle_capture_debug.h"
+#include "kwinscreenshot_interface.h"
 
-#include <QDBusInterface>
+#include "MemfdReader.h"
+#include "PipeReader.h"
+#include "SpectacleConfig.h"
+
+#include <QBuffer>
 #include <QDBusPendingCall>
+#include <QDBusPendingCallWatcher>
 #include <QDBusPendingReply>
 #include <QDBusUnixFileDescriptor>
 #include <QFutureWatcher>
+#include <QGuiApplication>
+#include <QImageReader>
+#include <QScreen>
+#include <QSharedPointer>
 #include <QtConcurrentRun>
-#include <qplatformdefs.h>
-
-#include <cerrno>
-
-static int readData(int fd, QByteArray &data)
-{
-    // implementation based on QtWayland file qwaylanddataoffer.cpp
-    char buf[4096];
-    int retryCount = 0;
-    int n;
-    while (true) {
-        n = QT_READ(fd, buf, sizeof buf);
-        // give user 30 sec to click a window, afterwards considered as error
-        if (n == -1 && (errno == EAGAIN) && ++retryCount < 30000) {
-            usleep(1000);
-        } else {
-            break;
-        }
-    }
-    if (n > 0) {
-        data.append(buf, n);
-        n = readData(fd, data);
-    }
-    return n;
-}
+#include <QtEndian>
+
+#include <fcntl.h>
+#include <unistd.h>
 
-static QImage readImage(int pipeFd)
+// KWin writes the image with QDataStream, which puts a big endian marker
+// for null images in front of a PNG image. the header is parsed here, so
+// the image can be decoded from the data as it was read from the pipe and
+// without asking every image plugin whether it recognizes the data
+
+static QImage readImage(const QByteArray &content)
 {
-    QByteArray content;
-    if (readData(pipeFd, content) != 0) {
-        close(pipeFd);
+    static const int HEADER_SIZE = 4;
+    if (content.size() <= HEADER_SIZE
+            || qFromBigEndian<qint32>(reinterpret_cast<const uchar *>(content.constData())) == 0) {
         return QImage();
     }
-    close(pipeFd);
-    QDataStream ds(content);
-    QImage image;
-    ds >> image;
-    return image;
+
+    QBuffer buffer;
+    buffer.setData(content);
+    if (!buffer.open(QIODevice::ReadOnly) || !buffer.seek(HEADER_SIZE)) {
+        return QImage();
+    }
+
+    QImageReader reader(&buffer, "png");
+    return reader.read();
 }
 
 KWinWaylandImageGrabber::KWinWaylandImageGrabber(QObject *parent) :
-    ImageGrabber(parent)
+    ImageGrabber(parent),
+    mKWinProxy(new KWinScreenshotProxy(this)),
+    mPipeReader(nullptr),
+    mMemfdReader(nullptr),
+    mMemfdSupported(true)
 {
 }
 
-KWinWaylandImageGrabber::~KWinWaylandImageGrabber() = default;
+KWinWaylandImageGrabber::~KWinWaylandImageGrabber()
+{
+    // images still being decoded may read from a mapped memory file
+
+    for (QFutureWatcher<QImage> *watcher : findChildren<QFutureWatcher<QImage> *>()) {
+        watcher->waitForFinished();
+    }
+}
 
 bool KWinWaylandImageGrabber::onClickGrabSupported() const
 {
@@ -89,13 +100,13 @@ void KWinWaylandImageGrabber::grabCurrentScreen()
 void KWinWaylandImageGrabber::grabActiveWindow()
 {
     // unsupported
-    emit pixmapChanged(QPixmap());
+    emit imageChanged(QImage());
 }
 
 void KWinWaylandImageGrabber::grabRectangularRegion()
 {
     // unsupported
-    emit pixmapChanged(QPixmap());
+    emit imageChanged(QImage());
 }
 
 void KWinWaylandImageGrabber::grabWindowUnderCursor()
@@ -116,47 +127,176 @@ void KWinWaylandImageGrabber::grabTransientWithParent()
     grabWindowUnderCursor();
 }
 
-QPixmap KWinWaylandImageGrabber::blendCursorImage(const QPixmap &pixmap, int x, int y, int width, int height)
+void KWinWaylandImageGrabber::blendCursorImage(QImage &image, int x, int y, int width, int height)
 {
+    Q_UNUSED(image)
     Q_UNUSED(x)
     Q_UNUSED(y)
     Q_UNUSED(width)
     Q_UNUSED(height)
-    return pixmap;
+}
+
+void KWinWaylandImageGrabber::cancelPendingRead()
+{
+    // a grab that's still waiting for KWin is superseded by the new one
+
+    if (mPipeReader) {
+        mPipeReader->cancel();
+        mPipeReader->deleteLater();
+        mPipeReader = nullptr;
+    }
+    if (mMemfdReader) {
+        mMemfdReader->cancel();
+        mMemfdReader->deleteLater();
+        mMemfdReader = nullptr;
+    }
 }
 
 void KWinWaylandImageGrabber::startReadImage(int readPipe)
 {
+    // the image arrives as a QImage serialized into a QDataStream, which
+    // usually is a PNG image. start with room for about a byte per pixel
+
+    QRect screenRect;
+    for (QScreen *screen : QGuiApplication::screens()) {
+        screenRect |= screen->geometry();
+    }
+    const qint64 expectedSize = static_cast<qint64>(screenRect.width()) * screenRect.height();
+
+    PipeReader *reader = new PipeReader(readPipe, this);
+    reader->setExpectedSize(static_cast<int>(qMin<qint64>(expectedSize, 256 * 1024 * 1024)));
+    reader->setTimeout(SpectacleConfig::instance()->compositorCaptureTimeout());
+    mPipeReader = reader;
+
+    connect(reader, &PipeReader::failed, this, [this, reader] {
+        mPipeReader = nullptr;
+        reader->deleteLater();
+        emit imageGrabFailed();
+    });
+    connect(reader, &PipeReader::finished, this, [this, reader](const QByteArray &content) {
+        mPipeReader = nullptr;
+        reader->deleteLater();
+        decodeImage(content, nullptr);
+    });
+
+    reader->start();
+}
+
+void KWinWaylandImageGrabber::startReadMemfd(MemfdReader *reader, const QDBusPendingCall &call, const std::function<void()> &pipeFallback)
+{
+    reader->setTimeout(SpectacleConfig::instance()->compositorCaptureTimeout());
+    mMemfdReader = reader;
+
+    // the pending call keeps the message it sent, which holds a duplicate
+    // of the write descriptor. the file is only closed for the last time
+    // once that is gone, so only the outcome of the call is kept
+
+    QSharedPointer<bool> rejected(new bool(false));
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(call, this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [rejected](QDBusPendingCallWatcher *pendingCall) {
+        pendingCall->deleteLater();
+        if (pendingCall->isError()) {
+            qCDebug(SPECTACLE_CAPTURE_LOG) << "KWin can't write screenshots to memory files:" << pendingCall->error().message();
+            *rejected = true;
+        }
+    });
+
+    // KWin closes the file without writing anything when the grab was
+    // cancelled. if it rejected the call instead, it can't handle the file
+    // and the grab is done again through a pipe
+
+    connect(reader, &MemfdReader::failed, this, [this, reader, rejected, pipeFallback]() {
+        mMemfdReader = nullptr;
+        reader->deleteLater();
+
+        if (*rejected) {
+            mMemfdSupported = false;
+            pipeFallback();
+            return;
+        }
+        emit imageGrabFailed();
+    });
+
+    // the data is decoded straight from the mapped file, which is why the
+    // reader has to stay around until the image is done
+
+    connect(reader, &MemfdReader::finished, this, [this, reader](const QByteArray &content) {
+        mMemfdReader = nullptr;
+        decodeImage(content, reader);
+    });
+
+    reader->start();
+}
+
+void KWinWaylandImageGrabber::decodeImage(const QByteArray &content, QObject *dataOwner)
+{
+    // decoding a large image takes a while, so it's kept off the GUI thread
     QFutureWatcher<QImage> *watcher = new QFutureWatcher<QImage>(this);
     QObject::connect(watcher, &QFutureWatcher<QImage>::finished, this,
-        [watcher, this] {
+        [watcher, dataOwner, this] {
             watcher->deleteLater();
-            const QImage img = watcher->result();
-            emit pixmapChanged(QPixmap::fromImage(img));
+            if (dataOwner) {
+                dataOwner->deleteLater();
+            }
+
+            // dropping the future's reference leaves the image with a
+            // single owner, so nothing down the line has to copy it
+            mImage = watcher->result();
+            watcher->setFuture(QFuture<QImage>());
+            emit imageChanged(mImage);
         }
     );
-    watcher->setFuture(QtConcurrent::run(readImage, readPipe));
+    watcher->setFuture(QtConcurrent::run(readImage, content));
 }
 
 template <typename T>
-void KWinWaylandImageGrabber::callDBus(Mode mode, int writeFd, T argument)
+QDBusPendingCall KWinWaylandImageGrabber::callDBus(Mode mode, int writeFd, T argument)
 {
-    QDBusInterface interface(QStringLiteral("org.kde.KWin"), QStringLiteral("/Screenshot"), QStringLiteral("org.kde.kwin.Screenshot"));
-    static const QMap<Mode, QString> s_hash = {
-        {Mode::Window, QStringLiteral("interactive")},
-        {Mode::CurrentScreen, QStringLiteral("screenshotScreen")},
-        {Mode::FullScreen, QStringLiteral("screenshotFullscreen")}
-    };
-    auto it = s_hash.find(mode);
-    Q_ASSERT(it != s_hash.end());
-    interface.asyncCall(it.value(), QVariant::fromValue(QDBusUnixFileDescriptor(writeFd)),  argument);
+    // the descriptor is duplicated when the message is built, so the write
+    // end can be closed as soon as this returns
+
+    OrgKdeKwinScreenshotInterface *screenshot = mKWinProxy->screenshot();
+    const QDBusUnixFileDescriptor fd(writeFd);
+    switch (mode) {
+    case Mode::Window:
+        return screenshot->interactive(fd, argument);
+    case Mode::CurrentScreen:
+        return screenshot->screenshotScreen(fd, argument);
+    case Mode::FullScreen:
+    default:
+        return screenshot->screenshotFullscreen(fd, argument);
+    }
 }
 
 template <typename T>
 void KWinWaylandImageGrabber::grab(Mode mode, T argument)
+{
+    cancelPendingRead();
+
+    // KWin writes into a memory file just as it would into a pipe, but the
+    // data doesn't have to be copied through the kernel and into a buffer
+
+    if (mMemfdSupported) {
+        MemfdReader *reader = new MemfdReader(this);
+        if (reader->isValid()) {
+            startReadMemfd(reader, callDBus(mode, reader->writeFd(), argument), [this, mode, argument] {
+                grabThroughPipe(mode, argument);
+            });
+            return;
+        }
+
+        delete reader;
+        mMemfdSupported = false;
+    }
+
+    grabThroughPipe(mode, argument);
+}
+
+template <typename T>
+void KWinWaylandImageGrabber::grabThroughPipe(Mode mode, T argument)
 {
     int pipeFds[2];
-    if (pipe2(pipeFds, O_CLOEXEC|O_NONBLOCK) != 0) {
+    if (pipe2(pipeFds, O_CLOEXEC) != 0) {
         emit imageGrabFailed();
         return;
     }
@@ -21,6 +21,13 @@
 
 #include "ImageGrabber.h"
 
+#include <functional>
+
+class KWinScreenshotProxy;
+class MemfdReader;
+class PipeReader;
+class QDBusPendingCall;
+
 class KWinWaylandImageGrabber : public ImageGrabber
 {
     Q_OBJECT
@@ -41,20 +48,31 @@ class KWinWaylandImageGrabber : public ImageGrabber
     void grabRectangularRegion()   override;
     void grabWindowUnderCursor()   override;
     void grabTransientWithParent() override;
-    QPixmap blendCursorImage(const QPixmap &pixmap, int x, int y, int width, int height) override;
+    void blendCursorImage(QImage &image, int x, int y, int width, int height) override;
 
     private:
 
-    void startReadImage(int readPipe);
     enum class Mode {
         Window,
         CurrentScreen,
         FullScreen
     };
+
+    void cancelPendingRead();
+    void startReadImage(int readPipe);
+    void startReadMemfd(MemfdReader *reader, const QDBusPendingCall &call, const std::function<void()> &pipeFallback);
+    void decodeImage(const QByteArray &content, QObject *dataOwner);
     template <typename T>
-    void callDBus(Mode mode, int writeFd, T argument);
+    QDBusPendingCall callDBus(Mode mode, int writeFd, T argument);
     template <typename T>
     void grab(Mode mode, T argument);
+    template <typename T>
+    void grabThroughPipe(Mode mode, T argument);
+
+    KWinScreenshotProxy *mKWinProxy;
+    PipeReader          *mPipeReader;
+    MemfdReader         *mMemfdReader;
+    bool                 mMemfdSupported;
 };
 
 #endif
@@ -0,0 +1,264 @@
+/*
+ *  Copyright (C) 2019 The Spectacle Developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "MemfdReader.h"
+#include "spectacle_capture_debug.h"
+#include "Config.h"
+
+#include <QSocketNotifier>
+#include <QTimer>
+#include <QtEndian>
+
+#include <cerrno>
+#include <cstring>
+#include <limits>
+
+#ifdef HAVE_MEMFD_CREATE
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// the size of the QDataStream null image marker, and the IEND chunk every
+// PNG image ends with
+
+static const int MARKER_SIZE = 4;
+static const uchar PNG_END[] = { 0, 0, 0, 0, 'I', 'E', 'N', 'D', 0xae, 0x42, 0x60, 0x82 };
+
+MemfdReader::MemfdReader(QObject *parent) :
+    QObject(parent),
+    mFd(-1),
+    mWriteFd(-1),
+    mInotifyFd(-1),
+    mTimeout(0),
+    mMapping(nullptr),
+    mMappingSize(0),
+    mNotifier(nullptr),
+    mTimer(nullptr)
+{
+#ifdef HAVE_MEMFD_CREATE
+    mFd = memfd_create("spectacle-screenshot", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (mFd < 0) {
+        return;
+    }
+
+    // the file has no other name than its /proc link. opening it again
+    // instead of duplicating the descriptor gives the compositor an open
+    // file of its own, and inotify only reports when the last descriptor
+    // for an open file is closed
+
+    const QByteArray path = "/proc/self/fd/" + QByteArray::number(mFd);
+    mWriteFd = open(path.constData(), O_WRONLY | O_CLOEXEC);
+    mInotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (mWriteFd < 0 || mInotifyFd < 0 || inotify_add_watch(mInotifyFd, path.constData(), IN_CLOSE_WRITE) < 0) {
+        qCDebug(SPECTACLE_CAPTURE_LOG) << "Cannot watch the memory file:" << strerror(errno);
+        stop();
+    }
+#endif
+}
+
+MemfdReader::~MemfdReader()
+{
+    stop();
+#ifdef HAVE_MEMFD_CREATE
+    if (mMapping) {
+        munmap(mMapping, static_cast<size_t>(mMappingSize));
+    }
+#endif
+}
+
+bool MemfdReader::isValid() const
+{
+    return mFd >= 0 && mInotifyFd >= 0 && (mWriteFd >= 0 || mNotifier);
+}
+
+int MemfdReader::writeFd() const
+{
+    return mWriteFd;
+}
+
+void MemfdReader::setTimeout(int msec)
+{
+    mTimeout = msec;
+}
+
+void MemfdReader::start()
+{
+    if (!isValid() || mNotifier) {
+        return;
+    }
+
+#ifdef HAVE_MEMFD_CREATE
+    close(mWriteFd);
+    mWriteFd = -1;
+#endif
+
+    mNotifier = new QSocketNotifier(mInotifyFd, QSocketNotifier::Read, this);
+    connect(mNotifier, &QSocketNotifier::activated, this, &MemfdReader::inotifyActivated);
+
+    if (mTimeout > 0) {
+        mTimer = new QTimer(this);
+        mTimer->setSingleShot(true);
+        connect(mTimer, &QTimer::timeout, this, &MemfdReader::timedOut);
+        mTimer->start(mTimeout);
+    }
+}
+
+void MemfdReader::cancel()
+{
+    stop();
+}
+
+void MemfdReader::stop()
+{
+    // this may run from the notifier's or the timer's own signal
+
+    if (mNotifier) {
+        mNotifier->setEnabled(false);
+        mNotifier->deleteLater();
+        mNotifier = nullptr;
+    }
+    if (mTimer) {
+        mTimer->stop();
+        mTimer->deleteLater();
+        mTimer = nullptr;
+    }
+
+#ifdef HAVE_MEMFD_CREATE
+    if (mWriteFd >= 0) {
+        close(mWriteFd);
+        mWriteFd = -1;
+    }
+    if (mInotifyFd >= 0) {
+        close(mInotifyFd);
+        mInotifyFd = -1;
+    }
+    if (mFd >= 0) {
+        close(mFd);
+        mFd = -1;
+    }
+#endif
+}
+
+void MemfdReader::inotifyActivated()
+{
+#ifdef HAVE_MEMFD_CREATE
+    // the events themselves don't matter, there is only one watch
+
+    char buffer[sizeof(inotify_event) * 16];
+    while (read(mInotifyFd, buffer, sizeof(buffer)) > 0) {
+    }
+
+    struct stat status;
+    if (fstat(mFd, &status) != 0) {
+        cancel();
+        emit failed();
+        return;
+    }
+
+    // the compositor closed the file for the last time, so anything short
+    // of a complete image means it gave up
+
+    if (!isComplete(status.st_size)) {
+        qCDebug(SPECTACLE_CAPTURE_LOG) << "Incomplete screenshot data," << status.st_size << "bytes";
+        cancel();
+        emit failed();
+        return;
+    }
+    finish(status.st_size);
+#endif
+}
+
+bool MemfdReader::isComplete(qint64 size) const
+{
+#ifdef HAVE_MEMFD_CREATE
+    uchar marker[MARKER_SIZE];
+    if (size < MARKER_SIZE || pread(mFd, marker, MARKER_SIZE, 0) != MARKER_SIZE) {
+        return false;
+    }
+
+    // a null image is nothing but the marker
+
+    if (qFromBigEndian<qint32>(marker) == 0) {
+        return size == MARKER_SIZE;
+    }
+
+    uchar end[sizeof(PNG_END)];
+    if (size < MARKER_SIZE + static_cast<qint64>(sizeof(PNG_END))
+            || pread(mFd, end, sizeof(end), size - sizeof(end)) != static_cast<ssize_t>(sizeof(end))) {
+        return false;
+    }
+    return memcmp(end, PNG_END, sizeof(end)) == 0;
+#else
+    Q_UNUSED(size);
+    return false;
+#endif
+}
+
+void MemfdReader::finish(qint64 size)
+{
+#ifdef HAVE_MEMFD_CREATE
+    if (size > std::numeric_limits<int>::max()) {
+        cancel();
+        emit failed();
+        return;
+    }
+
+    // once sealed, nobody who might still hold a descriptor can change or
+    // truncate the file while it's mapped
+
+    const int seals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL;
+    void *mapping = MAP_FAILED;
+    if (fcntl(mFd, F_ADD_SEALS, seals) == 0) {
+        mapping = mmap(nullptr, static_cast<size_t>(size), PROT_READ, MAP_SHARED, mFd, 0);
+    } else {
+        qCDebug(SPECTACLE_CAPTURE_LOG) << "Cannot seal the memory file:" << strerror(errno);
+    }
+
+    QByteArray data;
+    if (mapping != MAP_FAILED) {
+        mMapping = mapping;
+        mMappingSize = size;
+        data = QByteArray::fromRawData(static_cast<const char *>(mMapping), static_cast<int>(size));
+    } else {
+        // without the seals the data is copied, so it can't change later on
+        mCopy.resize(static_cast<int>(size));
+        if (pread(mFd, mCopy.data(), static_cast<size_t>(size), 0) != size) {
+            cancel();
+            emit failed();
+            return;
+        }
+        data = mCopy;
+    }
+
+    stop();
+    emit finished(data);
+#else
+    Q_UNUSED(size);
+#endif
+}
+
+void MemfdReader::timedOut()
+{
+    qCWarning(SPECTACLE_CAPTURE_LOG) << "Timed out waiting for the screenshot data";
+    cancel();
+    emit failed();
+}
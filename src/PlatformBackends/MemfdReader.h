@@ -0,0 +1,93 @@
+/*
+ *  Copyright (C) 2019 The Spectacle Developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#ifndef MEMFDREADER_H
+#define MEMFDREADER_H
+
+#include <QByteArray>
+#include <QObject>
+
+class QSocketNotifier;
+class QTimer;
+
+// Receives a screenshot through an anonymous memory file instead of a pipe.
+//
+// The write descriptor is handed to the compositor in place of the write end
+// of a pipe. It's opened separately from the one the reader keeps, so
+// inotify reports IN_CLOSE_WRITE as soon as the compositor, the last one to
+// hold it, closes it. Once the data is complete, the file is sealed against
+// further changes and mapped, so the data is never copied into this process.
+//
+// The data is checked for completeness before it's used, which catches a
+// compositor that gave up. The check knows the QDataStream serialization
+// of a QImage, a marker followed by a PNG image.
+
+class MemfdReader : public QObject
+{
+    Q_OBJECT
+
+    public:
+
+    explicit MemfdReader(QObject *parent = nullptr);
+    ~MemfdReader() override;
+
+    // false if memory files or inotify are not available
+    bool isValid() const;
+
+    // to be passed to the compositor before start() is called, which
+    // closes the reader's own copy
+    int writeFd() const;
+
+    // fail if the data isn't complete after this long. a timeout of zero,
+    // the default, waits forever
+    void setTimeout(int msec);
+
+    void start();
+    void cancel();
+
+    Q_SIGNALS:
+
+    // the data is a view of the mapped file, which stays valid until the
+    // reader is destroyed
+    void finished(const QByteArray &data);
+    void failed();
+
+    private Q_SLOTS:
+
+    void inotifyActivated();
+    void timedOut();
+
+    private:
+
+    bool isComplete(qint64 size) const;
+    void finish(qint64 size);
+    void stop();
+
+    int              mFd;
+    int              mWriteFd;
+    int              mInotifyFd;
+    int              mTimeout;
+    void            *mMapping;
+    qint64           mMappingSize;
+    QByteArray       mCopy;
+    QSocketNotifier *mNotifier;
+    QTimer          *mTimer;
+};
+
+#endif // MEMFDREADER_H
@@ -0,0 +1,170 @@
+/*
+ *  Copyright (C) 2019 The Spectacle Developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "PipeReader.h"
+#include "spectacle_capture_debug.h"
+
+#include <QSocketNotifier>
+#include <QTimer>
+
+#include <cerrno>
+#include <cstring>
+#include <limits>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// the size of the buffer when there is no hint about the amount of data
+
+static const int MIN_READ_SIZE = 256 * 1024;
+
+PipeReader::PipeReader(int fd, QObject *parent) :
+    QObject(parent),
+    mFd(fd),
+    mExpectedSize(0),
+    mTimeout(0),
+    mFill(0),
+    mNotifier(nullptr),
+    mTimer(nullptr)
+{
+    const int flags = fcntl(mFd, F_GETFL);
+    if (flags != -1) {
+        fcntl(mFd, F_SETFL, flags | O_NONBLOCK);
+    }
+}
+
+PipeReader::~PipeReader()
+{
+    stop();
+}
+
+void PipeReader::setExpectedSize(int size)
+{
+    mExpectedSize = size;
+}
+
+void PipeReader::setTimeout(int msec)
+{
+    mTimeout = msec;
+}
+
+void PipeReader::start()
+{
+    if (mFd < 0 || mNotifier) {
+        return;
+    }
+
+    // one byte more than expected leaves room for the read that finds the
+    // end of the pipe, so an exact hint never has the buffer grow
+
+    mData.resize(mExpectedSize > 0 ? mExpectedSize + 1 : MIN_READ_SIZE);
+    mFill = 0;
+
+    mNotifier = new QSocketNotifier(mFd, QSocketNotifier::Read, this);
+    connect(mNotifier, &QSocketNotifier::activated, this, &PipeReader::readAvailable);
+
+    if (mTimeout > 0) {
+        mTimer = new QTimer(this);
+        mTimer->setSingleShot(true);
+        connect(mTimer, &QTimer::timeout, this, &PipeReader::timedOut);
+        mTimer->start(mTimeout);
+    }
+}
+
+void PipeReader::cancel()
+{
+    stop();
+    mData.clear();
+}
+
+void PipeReader::stop()
+{
+    // this may run from the notifier's or the timer's own signal
+
+    if (mNotifier) {
+        mNotifier->setEnabled(false);
+        mNotifier->deleteLater();
+        mNotifier = nullptr;
+    }
+    if (mTimer) {
+        mTimer->stop();
+        mTimer->deleteLater();
+        mTimer = nullptr;
+    }
+
+    if (mFd >= 0) {
+        close(mFd);
+        mFd = -1;
+    }
+}
+
+void PipeReader::readAvailable()
+{
+    // read until the pipe is empty, the next chunk triggers the notifier again
+
+    const int previousFill = mFill;
+    for (;;) {
+        if (mFill == mData.size()) {
+            const int maxSize = std::numeric_limits<int>::max();
+            if (mData.size() > maxSize / 2) {
+                qCWarning(SPECTACLE_CAPTURE_LOG) << "Too much data in the pipe";
+                cancel();
+                emit failed();
+                return;
+            }
+            mData.resize(mData.size() * 2);
+        }
+
+        const ssize_t count = read(mFd, mData.data() + mFill, mData.size() - mFill);
+        if (count > 0) {
+            mFill += static_cast<int>(count);
+            continue;
+        }
+
+        if (count == 0) {
+            stop();
+            mData.resize(mFill);
+            emit finished(mData);
+            return;
+        }
+
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        }
+
+        qCWarning(SPECTACLE_CAPTURE_LOG) << "Failed to read from the pipe:" << strerror(errno);
+        cancel();
+        emit failed();
+        return;
+    }
+
+    if (mTimer && mFill != previousFill) {
+        mTimer->start(mTimeout);
+    }
+}
+
+void PipeReader::timedOut()
+{
+    qCWarning(SPECTACLE_CAPTURE_LOG) << "Timed out waiting for the pipe";
+    cancel();
+    emit failed();
+}
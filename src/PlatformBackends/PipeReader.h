@@ -0,0 +1,79 @@
+/*
+ *  Copyright (C) 2019 The Spectacle Developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#ifndef PIPEREADER_H
+#define PIPEREADER_H
+
+#include <QByteArray>
+#include <QObject>
+
+class QSocketNotifier;
+class QTimer;
+
+// Reads everything written to a pipe until the writer closes it, driven by
+// the event loop instead of a thread that polls.
+//
+// The data is read in large chunks straight into a buffer that is sized
+// for the expected amount of data up front and doubles when it's full.
+// The reader owns the file descriptor and closes it when it's done, when it
+// is cancelled or when it's destroyed.
+
+class PipeReader : public QObject
+{
+    Q_OBJECT
+
+    public:
+
+    explicit PipeReader(int fd, QObject *parent = nullptr);
+    ~PipeReader() override;
+
+    // a hint for the initial size of the buffer
+    void setExpectedSize(int size);
+
+    // fail if nothing was written to the pipe for this long. a timeout of
+    // zero, the default, waits forever
+    void setTimeout(int msec);
+
+    void start();
+    void cancel();
+
+    Q_SIGNALS:
+
+    void finished(const QByteArray &data);
+    void failed();
+
+    private Q_SLOTS:
+
+    void readAvailable();
+    void timedOut();
+
+    private:
+
+    void stop();
+
+    int              mFd;
+    int              mExpectedSize;
+    int              mTimeout;
+    int              mFill;
+    QByteArray       mData;
+    QSocketNotifier *mNotifier;
+    QTimer          *mTimer;
+};
+
+#endif // PIPEREADER_H
@@ -0,0 +1,104 @@
+/*
+ *  Copyright (C) 2019 The Spectacle Developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "X11CursorCache.h"
+
+#include <QGuiApplication>
+
+#include <xcb/xfixes.h>
+
+// most applications only use a handful of different cursors
+
+static const int MAX_CACHED_CURSORS = 16;
+
+X11CursorCache::X11CursorCache(xcb_connection_t *connection, xcb_window_t rootWindow) :
+    QAbstractNativeEventFilter(),
+    mFirstEvent(0),
+    mTracking(false),
+    mSerialKnown(false),
+    mCurrentSerial(0),
+    mImages(MAX_CACHED_CURSORS)
+{
+    // the XFixes version has already been negotiated by the xcb platform
+    // plugin on this connection, so we can ask for cursor notifications
+    // right away. without them, nothing is ever served from the cache
+
+    const xcb_query_extension_reply_t *extension = xcb_get_extension_data(connection, &xcb_xfixes_id);
+    if (extension && extension->present) {
+        mFirstEvent = extension->first_event;
+        xcb_xfixes_select_cursor_input(connection, rootWindow, XCB_XFIXES_CURSOR_NOTIFY_MASK_DISPLAY_CURSOR);
+        mTracking = true;
+        qApp->installNativeEventFilter(this);
+    }
+}
+
+X11CursorCache::~X11CursorCache()
+{
+    if (mTracking) {
+        qApp->removeNativeEventFilter(this);
+    }
+}
+
+bool X11CursorCache::currentCursor(QImage &image, QPoint &hotspot) const
+{
+    if (!mTracking || !mSerialKnown) {
+        return false;
+    }
+
+    const CursorImage *cursor = mImages.object(mCurrentSerial);
+    if (!cursor) {
+        return false;
+    }
+
+    image = cursor->image;
+    hotspot = cursor->hotspot;
+    return true;
+}
+
+void X11CursorCache::insert(quint32 serial, const QImage &image, const QPoint &hotspot)
+{
+    if (!mTracking) {
+        return;
+    }
+
+    // the fetched cursor is the one being displayed. any CursorNotify
+    // events still in the queue are handled afterwards and override this
+
+    mImages.insert(serial, new CursorImage { image, hotspot });
+    mCurrentSerial = serial;
+    mSerialKnown = true;
+}
+
+bool X11CursorCache::nativeEventFilter(const QByteArray &eventType, void *message, long *result)
+{
+    Q_UNUSED(result);
+
+    if (eventType != "xcb_generic_event_t") {
+        return false;
+    }
+
+    xcb_generic_event_t *event = static_cast<xcb_generic_event_t *>(message);
+    if ((event->response_type & ~0x80) == mFirstEvent + XCB_XFIXES_CURSOR_NOTIFY) {
+        xcb_xfixes_cursor_notify_event_t *cursorEvent = reinterpret_cast<xcb_xfixes_cursor_notify_event_t *>(event);
+        mCurrentSerial = cursorEvent->cursor_serial;
+        mSerialKnown = true;
+    }
+
+    return false;
+}
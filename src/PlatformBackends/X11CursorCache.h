@@ -0,0 +1,65 @@
+/*
+ *  Copyright (C) 2019 The Spectacle Developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#ifndef X11CURSORCACHE_H
+#define X11CURSORCACHE_H
+
+#include <QAbstractNativeEventFilter>
+#include <QCache>
+#include <QImage>
+#include <QPoint>
+
+#include <xcb/xcb.h>
+
+// A cache of the cursor images XFixes has handed out, keyed by their cursor
+// serial.
+//
+// XFixes tells us whenever the displayed cursor changes, so once a cursor
+// image has been fetched it can be reused without asking the X server again
+// for as long as it's displayed, or when it's displayed again later.
+
+class X11CursorCache : public QAbstractNativeEventFilter
+{
+    public:
+
+    explicit X11CursorCache(xcb_connection_t *connection, xcb_window_t rootWindow);
+    ~X11CursorCache() override;
+
+    // returns false if the current cursor isn't cached and has to be fetched
+    bool currentCursor(QImage &image, QPoint &hotspot) const;
+    void insert(quint32 serial, const QImage &image, const QPoint &hotspot);
+
+    bool nativeEventFilter(const QByteArray &eventType, void *message, long *result) override;
+
+    private:
+
+    struct CursorImage
+    {
+        QImage image;
+        QPoint hotspot;
+    };
+
+    quint8                         mFirstEvent;
+    bool                           mTracking;
+    bool                           mSerialKnown;
+    quint32                        mCurrentSerial;
+    QCache<quint32, CursorImage>   mImages;
+};
+
+#endif // X11CURSORCACHE_H
@@ -24,39 +24,96 @@
  */
 
 #include "X11ImageGrabber.h"
+#include "spectacle_capture_debug.h"
+#include "ImageProcessing/ImageViews.h"
+#include "ImageProcessing/PixelKernels.h"
+#include "SpectacleConfig.h"
+#include "PipeReader.h"
+#include "kwinscreenshot_interface.h"
+#include "kwinscreenshot2_interface.h"
 
 #include <KWindowSystem>
 
-#include <QDBusConnection>
-#include <QDBusConnectionInterface>
-#include <QDBusInterface>
-#include <QGraphicsDropShadowEffect>
-#include <QGraphicsPixmapItem>
-#include <QGraphicsScene>
+#include <QDBusPendingCallWatcher>
+#include <QDBusUnixFileDescriptor>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QMutexLocker>
 #include <QPainter>
 #include <QSet>
+#include <QSharedPointer>
 #include <QStack>
 #include <QX11Info>
+#include <QtConcurrentMap>
+#include <QtConcurrentRun>
 #include <QtMath>
 
-#include <KWindowInfo>
-
 #include <xcb/xcb_cursor.h>
 #include <xcb/xcb_util.h>
 #include <xcb/xfixes.h>
 
+#ifdef XCB_COMPOSITE_FOUND
+#include <xcb/composite.h>
+#endif
+
 #include <X11/Xatom.h>
 #include <X11/Xdefs.h>
 
+#include <algorithm>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// streamed grabs read the screen in bands of about this many bytes
+
+static const int STREAM_BAND_BYTES = 16 * 1024 * 1024;
+
+// what the round trips of reading one window on its own cost, in pixels,
+// when deciding whether to crop all windows from one grab of the screen
+
+static const int WINDOW_REQUEST_COST = 256 * 256;
+
 X11ImageGrabber::X11ImageGrabber(QObject *parent) :
-    ImageGrabber(parent)
+    ImageGrabber(parent),
+    mKWinGrabPending(false),
+    mRoundTrips(0),
+    mCompositeChecked(false),
+    mCompositeAvailable(false)
 {
     mNativeEventFilter = new OnClickEventFilter(this);
+    mImageReader = new X11ImageReader(QX11Info::connection());
+    mWindowIndex = new X11WindowIndex(QX11Info::connection(), QX11Info::appRootWindow(), this);
+    mCursorCache = new X11CursorCache(QX11Info::connection(), QX11Info::appRootWindow());
+    mScreenLayout = new X11ScreenLayout(QX11Info::connection(), QX11Info::appRootWindow(), this);
+    mKWinProxy = new KWinScreenshotProxy(this);
+    connect(mKWinProxy->screenshot(), &OrgKdeKwinScreenshotInterface::screenshotCreated, this, &X11ImageGrabber::KWinDBusScreenshotHelper);
+
+    // most captures finish long after doImageGrab() returned, so the round
+    // trips are only counted up once the result is out
+
+    auto logRoundTrips = [this] {
+        qCDebug(SPECTACLE_CAPTURE_LOG) << "Capture took" << mRoundTrips << "round trips to the X server";
+    };
+    connect(this, &ImageGrabber::imageChanged, this, logRoundTrips);
+    connect(this, &ImageGrabber::windowImagesChanged, this, logRoundTrips);
+    connect(this, &ImageGrabber::imageGrabFailed, this, logRoundTrips);
+
+    qCDebug(SPECTACLE_CAPTURE_LOG) << "Using" << PixelKernels::instructionSet() << "pixel conversion kernels";
 }
 
 X11ImageGrabber::~X11ImageGrabber()
 {
     delete mNativeEventFilter;
+    // grabs still running on the thread pool use the readers
+
+    for (QFutureWatcher<QImage> *watcher : findChildren<QFutureWatcher<QImage> *>()) {
+        watcher->waitForFinished();
+    }
+
+    delete mImageReader;
+    delete mCursorCache;
+    qDeleteAll(mIdleReaders);
 }
 
 // for onClick grab
@@ -107,6 +164,16 @@ bool X11ImageGrabber::onClickGrabSupported() const
     return true;
 }
 
+void X11ImageGrabber::doImageGrab()
+{
+    // every time we wait for a reply from the X server is counted, to keep
+    // an eye on the latency over remote connections. requests made through
+    // KWindowSystem and the asynchronous KWin path are not included
+
+    mRoundTrips = 0;
+    ImageGrabber::doImageGrab();
+}
+
 void X11ImageGrabber::doOnClickGrab()
 {
     // get the cursor image
@@ -170,10 +237,59 @@ void X11ImageGrabber::doOnClickGrab()
     xcb_free_cursor(QX11Info::connection(), xcbCursor);
 }
 
-// image conversion routine
+// image conversion routines
+
+static void xcbImageCleanup(void *xcbImage)
+{
+    xcb_image_destroy(static_cast<xcb_image_t *>(xcbImage));
+}
+
+// converts one scanline of a 16, 24 or 30 bit deep native image to RGB32.
+// for the 32 bits per pixel depths this works in place as well
+
+static void convertNativeRow(int depth, quint32 *dst, const quint8 *src, int count)
+{
+    switch (depth) {
+    case 16:
+        PixelKernels::rgb16ToRgb32(dst, reinterpret_cast<const quint16 *>(src), count);
+        break;
+    case 24:
+        // the RGB32 format requires data format 0xffRRGGBB, ensure that this fourth byte really is 0xff
+        PixelKernels::fillAlpha(dst, reinterpret_cast<const quint32 *>(src), count);
+        break;
+    case 30:
+        PixelKernels::bgr30ToRgb32(dst, reinterpret_cast<const quint32 *>(src), count);
+        break;
+    }
+}
+
+// copies a native image into a larger RGB32 or ARGB32_Premultiplied
+// buffer, converting it on the way. used to assemble screen tiles
 
-QPixmap X11ImageGrabber::convertFromNative(xcb_image_t *xcbImage)
+static bool copyNativePixels(int depth, const quint8 *src, int srcStride, const QSize &size, uchar *dst, int dstStride)
 {
+    if (depth != 16 && depth != 24 && depth != 30 && depth != 32) {
+        return false;
+    }
+
+    for (int y = 0; y < size.height(); ++y) {
+        quint32 *dstRow = reinterpret_cast<quint32 *>(dst + y * dstStride);
+        const quint8 *srcRow = src + y * srcStride;
+        if (depth == 32) {
+            memcpy(dstRow, srcRow, size.width() * 4);
+        } else {
+            convertNativeRow(depth, dstRow, srcRow, size.width());
+        }
+    }
+    return true;
+}
+
+QImage X11ImageGrabber::convertFromNative(xcb_image_t *xcbImage, bool isShared)
+{
+    // we own the native image from here on, make sure it's freed on every
+    // path where the QImage doesn't take it over
+
+    QScopedPointer<xcb_image_t, ScopedPointerXcbImageDeleter> nativeImage(xcbImage);
     QImage::Format format = QImage::Format_Invalid;
 
     switch (xcbImage->depth) {
@@ -181,33 +297,60 @@ QPixmap X11ImageGrabber::convertFromNative(xcb_image_t *xcbImage)
         format = QImage::Format_MonoLSB;
         break;
     case 16:
-        format = QImage::Format_RGB16;
-        break;
     case 24:
-        format = QImage::Format_RGB32;
-        break;
     case 30:
-        format = QImage::Format_BGR30;
+        // everything without an alpha channel ends up as RGB32, which is
+        // what QPixmap uses on X11 anyway
+        format = QImage::Format_RGB32;
         break;
     case 32:
         format = QImage::Format_ARGB32_Premultiplied;
         break;
     default:
-        return QPixmap(); // we don't know
+        return QImage(); // we don't know
     }
 
-    // The RGB32 format requires data format 0xffRRGGBB, ensure that this fourth byte really is 0xff
-    if (format == QImage::Format_RGB32) {
-        quint32 *data = reinterpret_cast<quint32 *>(xcbImage->data);
-        for (int i = 0; i < xcbImage->width * xcbImage->height; i++) {
-            data[i] |= 0xff000000;
+    const bool needsConversion = (format == QImage::Format_RGB32);
+    const bool isWideNative = (xcbImage->bpp == 32);
+
+    QImage image;
+    if (isShared || (needsConversion && !isWideNative)) {
+        // the pixels live in the reused shared memory segment or can't be
+        // converted in place, so they have to go into a new buffer anyway.
+        // the conversion is fused with that copy
+
+        if (needsConversion) {
+            image = QImage(xcbImage->width, xcbImage->height, format);
+            if (image.isNull()) {
+                return QImage();
+            }
+            for (int y = 0; y < xcbImage->height; ++y) {
+                convertNativeRow(xcbImage->depth, reinterpret_cast<quint32 *>(image.scanLine(y)),
+                                 xcbImage->data + y * xcbImage->stride, xcbImage->width);
+            }
+        } else {
+            image = QImage(xcbImage->data, xcbImage->width, xcbImage->height, xcbImage->stride, format).copy();
+        }
+    } else {
+        // the QImage adopts the buffer of the X reply and frees it once the
+        // last copy of the image goes away, so no copy is made at all
+
+        if (needsConversion) {
+            for (int y = 0; y < xcbImage->height; ++y) {
+                quint32 *row = reinterpret_cast<quint32 *>(xcbImage->data + y * xcbImage->stride);
+                convertNativeRow(xcbImage->depth, row, reinterpret_cast<const quint8 *>(row), xcbImage->width);
+            }
         }
-    }
 
-    QImage image(xcbImage->data, xcbImage->width, xcbImage->height, format);
+        image = QImage(xcbImage->data, xcbImage->width, xcbImage->height, xcbImage->stride, format,
+                       xcbImageCleanup, xcbImage);
+        if (!image.isNull()) {
+            nativeImage.take();
+        }
+    }
 
     if (image.isNull()) {
-        return QPixmap();
+        return QImage();
     }
 
     // work around an abort in QImage::color
@@ -218,187 +361,742 @@ QPixmap X11ImageGrabber::convertFromNative(xcb_image_t *xcbImage)
         image.setColor(1, QColor(Qt::black).rgb());
     }
 
-    // Image is ready. Since the backing data from xcbImage could be freed
-    // before the QPixmap goes away, a deep copy is necessary.
-    return QPixmap::fromImage(image).copy();
+    return image;
 }
 
 // utility functions
 
-// Note: x, y, width and height are measured in device pixels
-QPixmap X11ImageGrabber::blendCursorImage(const QPixmap &pixmap, int x, int y, int width, int height)
+// Note: the returned hotspot is measured in device pixels
+QImage X11ImageGrabber::getCursorImage(QPoint &hotspot)
 {
-    // If the cursor position lies outside the area, do not bother drawing a cursor.
-
-    QPoint cursorPos = getNativeCursorPosition();
-    QRect screenRect(x, y, width, height);
+    // the cursor usually hasn't changed since the last capture
 
-    if (!screenRect.contains(cursorPos)) {
-        return pixmap;
+    QImage cursorImage;
+    if (mCursorCache->currentCursor(cursorImage, hotspot)) {
+        return cursorImage;
     }
 
-    // now we can get the image and start processing
-
     xcb_connection_t *xcbConn = QX11Info::connection();
 
     xcb_xfixes_get_cursor_image_cookie_t  cursorCookie = xcb_xfixes_get_cursor_image_unchecked(xcbConn);
     CScopedPointer<xcb_xfixes_get_cursor_image_reply_t>  cursorReply(xcb_xfixes_get_cursor_image_reply(xcbConn, cursorCookie, nullptr));
+    ++mRoundTrips;
     if (cursorReply.isNull()) {
-        return pixmap;
+        return QImage();
     }
 
     quint32 *pixelData = xcb_xfixes_get_cursor_image_cursor_image(cursorReply.data());
     if (!pixelData) {
-        return pixmap;
+        return QImage();
     }
 
-    // process the image into a QImage
+    // a small fix for the cursor position for fancier cursors
 
-    QImage cursorImage = QImage((quint8 *)pixelData, cursorReply->width, cursorReply->height, QImage::Format_ARGB32_Premultiplied);
+    hotspot = QPoint(cursorReply->xhot, cursorReply->yhot);
 
-    // a small fix for the cursor position for fancier cursors
+    // process the image into a QImage. the reply goes away when we return,
+    // the (small) cursor image has to be copied out of it
+
+    cursorImage = QImage((quint8 *)pixelData, cursorReply->width, cursorReply->height, QImage::Format_ARGB32_Premultiplied).copy();
+    mCursorCache->insert(cursorReply->cursor_serial, cursorImage, hotspot);
+    return cursorImage;
+}
 
-    cursorPos -= QPoint(cursorReply->xhot, cursorReply->yhot);
+// blends the cursor into the image without a QPainter, touching nothing
+// but the pixels below the cursor
 
-    // now we translate the cursor point to our screen rectangle
+static void drawCursorImage(QImage &image, const QPoint &pos, const QImage &cursorImage)
+{
+    if (image.format() != QImage::Format_RGB32 && image.format() != QImage::Format_ARGB32_Premultiplied) {
+        QPainter painter(&image);
+        painter.drawImage(pos, cursorImage);
+        return;
+    }
 
-    cursorPos -= QPoint(x, y);
+    const QRect area = QRect(pos, cursorImage.size()) & image.rect();
+    for (int y = area.top(); y <= area.bottom(); ++y) {
+        quint32 *dst = reinterpret_cast<quint32 *>(image.scanLine(y)) + area.left();
+        const quint32 *src = reinterpret_cast<const quint32 *>(cursorImage.constScanLine(y - pos.y())) + (area.left() - pos.x());
+        PixelKernels::blendPremultiplied(dst, src, area.width());
+    }
+}
+
+// Note: x, y, width and height are measured in device pixels
+void X11ImageGrabber::blendCursorImage(QImage &image, int x, int y, int width, int height)
+{
+    // If the cursor position lies outside the area, do not bother drawing a cursor.
+
+    QPoint cursorPos = getNativeCursorPosition();
+    QRect screenRect(x, y, width, height);
 
-    // and do the painting
+    if (!screenRect.contains(cursorPos)) {
+        return;
+    }
+
+    // now we can get the image and start processing
 
-    QPixmap blendedPixmap = pixmap;
-    QPainter painter(&blendedPixmap);
-    painter.drawImage(cursorPos, cursorImage);
+    QPoint hotspot;
+    const QImage cursorImage = getCursorImage(hotspot);
+    if (cursorImage.isNull()) {
+        return;
+    }
+
+    // now we translate the cursor point to our screen rectangle
+
+    cursorPos -= hotspot;
+    cursorPos -= QPoint(x, y);
 
-    // and done
+    // and do the blending. the image is changed in place, so as long as
+    // nobody else holds a reference to it, it is not detached (copied)
 
-    return blendedPixmap;
+    drawCursorImage(image, cursorPos, cursorImage);
 }
 
-QPixmap X11ImageGrabber::getPixmapFromDrawable(xcb_drawable_t drawableId, const QRect &rect)
+QImage X11ImageGrabber::getImageFromDrawable(xcb_drawable_t drawableId, const QRect &rect)
 {
-    xcb_connection_t *xcbConn = QX11Info::connection();
+    QElapsedTimer captureTimer;
+    captureTimer.start();
 
-    // proceed to get an image based on the geometry (in device pixels)
-
-    QScopedPointer<xcb_image_t, ScopedPointerXcbImageDeleter> xcbImage(
-        xcb_image_get(
-            xcbConn,
-            drawableId,
-            rect.x(),
-            rect.y(),
-            rect.width(),
-            rect.height(),
-            ~0,
-            XCB_IMAGE_FORMAT_Z_PIXMAP
-        )
-    );
+    // proceed to get an image based on the geometry (in device pixels). this
+    // goes through a shared memory segment if the X server supports it
+
+    bool isShared = false;
+    xcb_image_t *xcbImage = mImageReader->getImage(drawableId, rect, &isShared);
+    ++mRoundTrips;
 
     // too bad, the capture failed.
-    if (xcbImage.isNull()) {
-        return QPixmap();
+    if (!xcbImage) {
+        return QImage();
     }
 
-    // now process the image
+    // now process the image. this hands the native image over to the QImage
+
+    QImage nativeImage = convertFromNative(xcbImage, isShared);
 
-    QPixmap nativePixmap = convertFromNative(xcbImage.data());
-    return nativePixmap;
+    qCDebug(SPECTACLE_CAPTURE_LOG) << "Captured" << rect << (isShared ? "through MIT-SHM" : "through GetImage")
+                                   << "in" << captureTimer.nsecsElapsed() / 1000000.0 << "ms";
+    return nativeImage;
 }
 
-// finalize the grabbed pixmap where we know the absolute position
-QPixmap X11ImageGrabber::postProcessPixmap(const QPixmap &pixmap, QRect rect, bool blendPointer)
+// finalize the grabbed image where we know the absolute position
+QImage X11ImageGrabber::postProcessImage(QImage image, QRect rect, bool blendPointer)
 {
-    if (!(blendPointer)) {
-        // note: this may be the null pixmap if an error occurred.
-        return pixmap;
+    // note: this may be the null image if an error occurred.
+    if (blendPointer && !image.isNull()) {
+        blendCursorImage(image, rect.x(), rect.y(), rect.width(), rect.height());
     }
 
-    return blendCursorImage(pixmap, rect.x(), rect.y(), rect.width(), rect.height());
+    return image;
+}
+
+QVector<QRect> X11ImageGrabber::getNativeScreenRects()
+{
+    return mScreenLayout->nativeRects();
 }
 
-QPixmap X11ImageGrabber::getToplevelPixmap(QRect rect, bool blendPointer)
+QRect X11ImageGrabber::planToplevelGrab(QRect rect, QVector<QRect> &tiles)
 {
     xcb_window_t rootWindow = QX11Info::appRootWindow();
+    const QVector<QRect> screenRects = getNativeScreenRects();
 
     // Treat a null rect as an alias for capturing fullscreen
     if (!rect.isValid()) {
         rect = getDrawableGeometry(rootWindow);
     } else {
         QRegion screenRegion;
-        for (auto screen : QGuiApplication::screens()) {
-            QRect screenRect = screen->geometry();
-
-            // Do not use setSize() here, because QSize::operator*=()
-            // performs qRound() which can result in xcb_image_get() failing
-            const qreal dpr = screen->devicePixelRatio();
-            screenRect.setHeight(qFloor(screenRect.height() * dpr));
-            screenRect.setWidth(qFloor(screenRect.width() * dpr));
-
+        for (const QRect &screenRect : screenRects) {
             screenRegion += screenRect;
         }
 
         rect = (screenRegion & rect).boundingRect();
     }
 
-    QPixmap nativePixmap = getPixmapFromDrawable(rootWindow, rect);
-    return postProcessPixmap(nativePixmap, rect, blendPointer);
+    // split the area into one tile per screen. cloned screens overlap, so
+    // every tile only gets the part that no other tile covers yet
+
+    tiles.clear();
+    QRegion coveredRegion;
+    for (const QRect &screenRect : screenRects) {
+        const QRegion tileRegion = QRegion(screenRect & rect) - coveredRegion;
+        for (const QRect &tile : tileRegion.rects()) {
+            tiles.append(tile);
+        }
+        coveredRegion += tileRegion;
+    }
+
+    return rect;
 }
 
-QPixmap X11ImageGrabber::getWindowPixmap(xcb_window_t window, bool blendPointer)
+QImage X11ImageGrabber::getToplevelImage(QRect rect, bool blendPointer)
 {
-    xcb_connection_t *xcbConn = QX11Info::connection();
+    xcb_window_t rootWindow = QX11Info::appRootWindow();
 
-    // first get geometry information for our window
+    QVector<QRect> tiles;
+    rect = planToplevelGrab(rect, tiles);
 
-    xcb_get_geometry_cookie_t geomCookie = xcb_get_geometry_unchecked(xcbConn, window);
-    CScopedPointer<xcb_get_geometry_reply_t> geomReply(xcb_get_geometry_reply(xcbConn, geomCookie, nullptr));
-    QRect rect(geomReply->x, geomReply->y, geomReply->width, geomReply->height);
+    QImage image;
+    if (tiles.size() > 1) {
+        image = getTiledImage(rootWindow, rect, tiles);
+    }
+    if (image.isNull()) {
+        image = getImageFromDrawable(rootWindow, rect);
+    }
 
-    // then proceed to get an image
+    return postProcessImage(std::move(image), rect, blendPointer);
+}
+
+// returns true if the connection talks to the same display as the
+// application, i.e. if it has our root window
+
+static bool isSameDisplay(xcb_connection_t *connection, xcb_window_t rootWindow)
+{
+    for (auto it = xcb_setup_roots_iterator(xcb_get_setup(connection)); it.rem; xcb_screen_next(&it)) {
+        if (it.data->root == rootWindow) {
+            return true;
+        }
+    }
+    return false;
+}
+
+QVector<X11ImageReader *> X11ImageGrabber::acquireReaders(int count)
+{
+    // readers are handed out to one grab at a time, overlapping grabs get
+    // readers of their own. they are kept for later grabs once returned
+
+    QVector<X11ImageReader *> readers;
+    {
+        QMutexLocker locker(&mReaderPoolMutex);
+        while (readers.size() < count && !mIdleReaders.isEmpty()) {
+            readers.append(mIdleReaders.takeLast());
+        }
+    }
+
+    const xcb_window_t rootWindow = QX11Info::appRootWindow();
+    while (readers.size() < count) {
+        X11ImageReader *reader = new X11ImageReader();
+        if (!reader->isConnected() || !isSameDisplay(reader->connection(), rootWindow)) {
+            qCDebug(SPECTACLE_CAPTURE_LOG) << "Could not open a worker connection to the display";
+            delete reader;
+            releaseReaders(readers);
+            return QVector<X11ImageReader *>();
+        }
+        readers.append(reader);
+    }
+    return readers;
+}
+
+void X11ImageGrabber::releaseReaders(const QVector<X11ImageReader *> &readers)
+{
+    QMutexLocker locker(&mReaderPoolMutex);
+    mIdleReaders += readers;
+}
+
+// the tile readers below only touch the image and the readers they are
+// given, so they can run on any thread
+
+static bool readTilesConcurrently(const QVector<X11ImageReader *> &readers, xcb_window_t rootWindow, QImage &image,
+                                  const QPoint &origin, const QVector<QRect> &tiles)
+{
+    // every tile is read through its own connection, so the tiles are
+    // requested and converted in parallel
+
+    struct TileJob
+    {
+        X11ImageReader *reader;
+        QRect tile;
+        bool ok;
+    };
+
+    QVector<TileJob> jobs;
+    for (int i = 0; i < tiles.size(); ++i) {
+        jobs.append({ readers.at(i), tiles.at(i), false });
+    }
+
+    // fetch the pointer once, so the workers don't race on detaching the image
+    uchar *bits = image.bits();
+    const int stride = image.bytesPerLine();
+
+    QtConcurrent::blockingMap(jobs, [=](TileJob &job) {
+        QScopedPointer<xcb_image_t, ScopedPointerXcbImageDeleter> xcbImage(job.reader->getImage(rootWindow, job.tile));
+        if (xcbImage.isNull()) {
+            return;
+        }
+
+        const QPoint offset = job.tile.topLeft() - origin;
+        job.ok = copyNativePixels(xcbImage->depth, xcbImage->data, xcbImage->stride, job.tile.size(),
+                                  bits + offset.y() * stride + offset.x() * 4, stride);
+    });
+
+    for (const TileJob &job : jobs) {
+        if (!job.ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool readTilesWithServerGrab(xcb_connection_t *xcbConn, xcb_window_t rootWindow, QImage &image,
+                                    const QPoint &origin, const QVector<QRect> &tiles)
+{
+    // queue all requests between the grab and the ungrab before waiting for
+    // any reply. the server handles them back to back, so it is grabbed only
+    // for as long as it takes to read the screens, and the grab can't be
+    // left behind if we bail out early
+
+    QVector<xcb_get_image_cookie_t> cookies;
+    xcb_grab_server(xcbConn);
+    for (const QRect &tile : tiles) {
+        cookies.append(xcb_get_image_unchecked(xcbConn, XCB_IMAGE_FORMAT_Z_PIXMAP, rootWindow,
+                                               tile.x(), tile.y(), tile.width(), tile.height(), ~0));
+    }
+    xcb_ungrab_server(xcbConn);
+    xcb_flush(xcbConn);
+
+    bool ok = true;
+    uchar *bits = image.bits();
+    const int stride = image.bytesPerLine();
+
+    for (int i = 0; i < tiles.size(); ++i) {
+        // collect every reply, even after a failure, so none of them is left
+        // in the connection's queue
+
+        CScopedPointer<xcb_get_image_reply_t> imageReply(xcb_get_image_reply(xcbConn, cookies.at(i), nullptr));
+        if (imageReply.isNull() || !ok) {
+            ok = false;
+            continue;
+        }
+
+        const QRect &tile = tiles.at(i);
+        const QPoint offset = tile.topLeft() - origin;
+        const int srcStride = xcb_get_image_data_length(imageReply.data()) / tile.height();
+        ok = copyNativePixels(imageReply->depth, xcb_get_image_data(imageReply.data()), srcStride, tile.size(),
+                              bits + offset.y() * stride + offset.x() * 4, stride);
+    }
+    return ok;
+}
+
+// assembles the tiles of a multi-screen grab into one image. a server grab
+// reads everything through the first reader, otherwise every tile needs a
+// reader of its own
+
+static QImage readTiledImage(const QVector<X11ImageReader *> &readers, bool grabServer, xcb_window_t rootWindow,
+                             const QRect &rect, const QVector<QRect> &tiles, bool hasAlpha)
+{
+    // the tiles are written straight into the final image, so the frame is
+    // assembled exactly once
+
+    QImage image(rect.size(), hasAlpha ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+    if (image.isNull()) {
+        return QImage();
+    }
+
+    // areas between screens of different sizes don't belong to any screen
+    // and contain garbage. paint them black
+
+    QRegion deadRegion(rect);
+    for (const QRect &tile : tiles) {
+        deadRegion -= tile;
+    }
+    if (!deadRegion.isEmpty()) {
+        QPainter painter(&image);
+        for (const QRect &deadRect : deadRegion.rects()) {
+            painter.fillRect(deadRect.translated(-rect.topLeft()), Qt::black);
+        }
+    }
+
+    const bool ok = grabServer ? readTilesWithServerGrab(readers.first()->connection(), rootWindow, image, rect.topLeft(), tiles)
+                               : readTilesConcurrently(readers, rootWindow, image, rect.topLeft(), tiles);
+    return ok ? image : QImage();
+}
+
+QImage X11ImageGrabber::getTiledImage(xcb_window_t rootWindow, const QRect &rect, const QVector<QRect> &tiles)
+{
+    QElapsedTimer captureTimer;
+    captureTimer.start();
+
+    // a server grab keeps other clients from drawing while the screens are
+    // read, so the tiles fit together. the worker connections would be
+    // locked out by the grab as well, so it's an either-or
+
+    const bool grabServer = SpectacleConfig::instance()->grabServerDuringCapture();
+    const QVector<X11ImageReader *> readers = grabServer ? QVector<X11ImageReader *>({ mImageReader })
+                                                         : acquireReaders(tiles.size());
+    if (readers.isEmpty()) {
+        return QImage();
+    }
+
+    const QImage image = readTiledImage(readers, grabServer, rootWindow, rect, tiles, QX11Info::appDepth() == 32);
+    if (!grabServer) {
+        releaseReaders(readers);
+    }
+    ++mRoundTrips;
+    if (image.isNull()) {
+        return QImage();
+    }
+
+    qCDebug(SPECTACLE_CAPTURE_LOG) << "Captured" << tiles.size() << "screens in" << rect
+                                   << (grabServer ? "under a server grab" : "concurrently")
+                                   << "in" << captureTimer.nsecsElapsed() / 1000000.0 << "ms";
+    return image;
+}
+
+void X11ImageGrabber::grabToplevelImageAsync(QRect rect, bool blendPointer, const std::function<void (const QImage &)> &done)
+{
+    // everything that needs the GUI thread or the application's connection
+    // happens right here: the screen layout, the cursor, the config. the
+    // pixel transfer and conversion run on the thread pool, through
+    // connections of their own
+
+    QVector<QRect> tiles;
+    rect = planToplevelGrab(rect, tiles);
+
+    QImage cursorImage;
+    QPoint cursorPos;
+    if (blendPointer) {
+        cursorPos = getNativeCursorPosition();
+        if (rect.contains(cursorPos)) {
+            QPoint hotspot;
+            cursorImage = getCursorImage(hotspot);
+            cursorPos -= hotspot + rect.topLeft();
+        }
+    }
+
+    const xcb_window_t rootWindow = QX11Info::appRootWindow();
+    const bool hasAlpha = (QX11Info::appDepth() == 32);
+    const bool grabServer = SpectacleConfig::instance()->grabServerDuringCapture();
+    const int readerCount = (tiles.size() > 1 && !grabServer) ? tiles.size() : 1;
+
+    QFutureWatcher<QImage> *watcher = new QFutureWatcher<QImage>(this);
+    connect(watcher, &QFutureWatcher<QImage>::finished, this, [watcher, done]() {
+        const QImage image = watcher->result();
+        watcher->deleteLater();
+        done(image);
+    });
+
+    watcher->setFuture(QtConcurrent::run([=]() {
+        QElapsedTimer captureTimer;
+        captureTimer.start();
+
+        const QVector<X11ImageReader *> readers = acquireReaders(readerCount);
+        if (readers.isEmpty()) {
+            return QImage();
+        }
 
-    QPixmap nativePixmap = getPixmapFromDrawable(window, rect);
+        QImage image;
+        if (tiles.size() > 1) {
+            image = readTiledImage(readers, grabServer, rootWindow, rect, tiles, hasAlpha);
+        }
+        if (image.isNull()) {
+            bool isShared = false;
+            xcb_image_t *xcbImage = readers.first()->getImage(rootWindow, rect, &isShared);
+            if (xcbImage) {
+                image = convertFromNative(xcbImage, isShared);
+            }
+        }
+        releaseReaders(readers);
 
-    // Translate window coordinates to global ones.
+        if (!image.isNull() && !cursorImage.isNull()) {
+            drawCursorImage(image, cursorPos, cursorImage);
+        }
+
+        qCDebug(SPECTACLE_CAPTURE_LOG) << "Captured" << rect << "on a worker thread in"
+                                       << captureTimer.nsecsElapsed() / 1000000.0 << "ms";
+        return image;
+    }));
+}
+
+QImage X11ImageGrabber::getWindowImage(xcb_window_t window, bool blendPointer)
+{
+    xcb_connection_t *xcbConn = QX11Info::connection();
 
-    xcb_get_geometry_cookie_t geomRootCookie = xcb_get_geometry_unchecked(xcbConn, geomReply->root);
-    CScopedPointer<xcb_get_geometry_reply_t> geomRootReply(xcb_get_geometry_reply(xcbConn, geomRootCookie, nullptr));
+    // ask for the geometry of our window and its position in global
+    // coordinates at the same time. the root window always sits at 0,0
 
+    xcb_get_geometry_cookie_t geomCookie = xcb_get_geometry_unchecked(xcbConn, window);
     xcb_translate_coordinates_cookie_t translateCookie = xcb_translate_coordinates_unchecked(
-        xcbConn, window, geomReply->root, geomRootReply->x, geomRootReply->y);
+        xcbConn, window, QX11Info::appRootWindow(), 0, 0);
+    CScopedPointer<xcb_get_geometry_reply_t> geomReply(xcb_get_geometry_reply(xcbConn, geomCookie, nullptr));
     CScopedPointer<xcb_translate_coordinates_reply_t> translateReply(
         xcb_translate_coordinates_reply(xcbConn, translateCookie, nullptr));
+    ++mRoundTrips;
+
+    if (geomReply.isNull() || translateReply.isNull()) {
+        return QImage();
+    }
+    QRect rect(geomReply->x, geomReply->y, geomReply->width, geomReply->height);
+
+    // then proceed to get an image
+
+    QImage nativeImage = getImageFromDrawable(window, rect);
 
     // Adjust local to global coordinates.
     rect.moveRight(rect.x() + translateReply->dst_x);
     rect.moveTop(rect.y() + translateReply->dst_y);
 
     // If the window capture failed, try to obtain one from the full screen.
-    if (nativePixmap.isNull()) {
-        return getToplevelPixmap(rect, blendPointer);
+    if (nativeImage.isNull()) {
+        return getToplevelImage(rect, blendPointer);
     }
 
-    return postProcessPixmap(nativePixmap, rect, blendPointer);
+    return postProcessImage(std::move(nativeImage), rect, blendPointer);
 }
 
-bool X11ImageGrabber::isKWinAvailable()
+bool X11ImageGrabber::isCompositeAvailable()
 {
-    if (QDBusConnection::sessionBus().interface()->isServiceRegistered(QStringLiteral("org.kde.KWin"))) {
-        QDBusInterface interface(QStringLiteral("org.kde.KWin"), QStringLiteral("/Effects"), QStringLiteral("org.kde.kwin.Effects"));
-        QDBusReply<bool> reply = interface.call(QStringLiteral("isEffectLoaded"), QStringLiteral("screenshot"));
+#ifdef XCB_COMPOSITE_FOUND
+    if (mCompositeChecked) {
+        return mCompositeAvailable;
+    }
+    mCompositeChecked = true;
 
-        return reply.value();
+    // NameWindowPixmap needs version 0.2 of the extension
+
+    xcb_connection_t *xcbConn = QX11Info::connection();
+    const xcb_query_extension_reply_t *extension = xcb_get_extension_data(xcbConn, &xcb_composite_id);
+    if (extension && extension->present) {
+        xcb_composite_query_version_cookie_t versionCookie = xcb_composite_query_version_unchecked(xcbConn, 0, 2);
+        CScopedPointer<xcb_composite_query_version_reply_t> versionReply(xcb_composite_query_version_reply(xcbConn, versionCookie, nullptr));
+        ++mRoundTrips;
+        mCompositeAvailable = !versionReply.isNull() && (versionReply->major_version > 0 || versionReply->minor_version >= 2);
     }
 
+    qCDebug(SPECTACLE_CAPTURE_LOG) << "XComposite capture path available:" << mCompositeAvailable;
+    return mCompositeAvailable;
+#else
     return false;
+#endif
+}
+
+QImage X11ImageGrabber::getCompositeWindowImage(xcb_window_t window, bool blendPointer)
+{
+#ifdef XCB_COMPOSITE_FOUND
+    if (!isCompositeAvailable()) {
+        return QImage();
+    }
+
+    xcb_connection_t *xcbConn = QX11Info::connection();
+    const xcb_window_t rootWindow = QX11Info::appRootWindow();
+
+    // only the children of the root window are redirected by the
+    // compositing manager, so walk up to the window manager frame. it has the
+    // backing pixmap the window is drawn into. compositing managers that draw
+    // the decoration themselves, kwin among them, leave the rest of it empty
+
+    xcb_window_t frameWindow = window;
+    forever {
+        xcb_query_tree_cookie_t treeCookie = xcb_query_tree_unchecked(xcbConn, frameWindow);
+        CScopedPointer<xcb_query_tree_reply_t> treeReply(xcb_query_tree_reply(xcbConn, treeCookie, nullptr));
+        ++mRoundTrips;
+        if (treeReply.isNull()) {
+            return QImage();
+        }
+        if (treeReply->parent == rootWindow || treeReply->parent == XCB_WINDOW_NONE) {
+            break;
+        }
+        frameWindow = treeReply->parent;
+    }
+
+    // the geometry of the frame, the size of the window and where the
+    // window sits inside the frame, all at once
+
+    xcb_get_geometry_cookie_t frameGeomCookie = xcb_get_geometry_unchecked(xcbConn, frameWindow);
+    xcb_get_geometry_cookie_t windowGeomCookie = xcb_get_geometry_unchecked(xcbConn, window);
+    xcb_translate_coordinates_cookie_t translateCookie = xcb_translate_coordinates_unchecked(xcbConn, window, frameWindow, 0, 0);
+    CScopedPointer<xcb_get_geometry_reply_t> frameGeomReply(xcb_get_geometry_reply(xcbConn, frameGeomCookie, nullptr));
+    CScopedPointer<xcb_get_geometry_reply_t> windowGeomReply(xcb_get_geometry_reply(xcbConn, windowGeomCookie, nullptr));
+    CScopedPointer<xcb_translate_coordinates_reply_t> translateReply(
+        xcb_translate_coordinates_reply(xcbConn, translateCookie, nullptr));
+    ++mRoundTrips;
+    if (frameGeomReply.isNull() || windowGeomReply.isNull() || translateReply.isNull()) {
+        return QImage();
+    }
+
+    // the pixmap includes the border of the frame window
+
+    const int border = frameGeomReply->border_width;
+    const QRect pixmapRect(0, 0, frameGeomReply->width + 2 * border, frameGeomReply->height + 2 * border);
+    const QRect sourceRect = QRect(translateReply->dst_x + border, translateReply->dst_y + border,
+                                   windowGeomReply->width, windowGeomReply->height) & pixmapRect;
+    if (sourceRect.isEmpty()) {
+        return QImage();
+    }
+
+    // naming the pixmap fails if the frame isn't redirected, which is the
+    // case when no compositing manager is running
+
+    xcb_pixmap_t pixmap = xcb_generate_id(xcbConn);
+    xcb_void_cookie_t nameCookie = xcb_composite_name_window_pixmap_checked(xcbConn, frameWindow, pixmap);
+    CScopedPointer<xcb_generic_error_t> nameError(xcb_request_check(xcbConn, nameCookie));
+    ++mRoundTrips;
+    if (!nameError.isNull()) {
+        qCDebug(SPECTACLE_CAPTURE_LOG) << "Window" << frameWindow << "has no composite pixmap";
+        return QImage();
+    }
+
+    bool isShared = false;
+    xcb_image_t *xcbImage = mImageReader->getImage(pixmap, sourceRect, &isShared);
+    ++mRoundTrips;
+    xcb_free_pixmap(xcbConn, pixmap);
+    if (!xcbImage) {
+        return QImage();
+    }
+
+    // the pixmap starts at the outer corner of the frame on the screen
+
+    QImage image = convertFromNative(xcbImage, isShared);
+    const QRect screenRect = sourceRect.translated(frameGeomReply->x, frameGeomReply->y);
+    return postProcessImage(std::move(image), screenRect, blendPointer);
+#else
+    Q_UNUSED(window);
+    Q_UNUSED(blendPointer);
+    return QImage();
+#endif
+}
+
+bool X11ImageGrabber::isKWinAvailable()
+{
+    return mKWinProxy->isAvailable();
+}
+
+static void byteArrayCleanup(void *data)
+{
+    delete static_cast<QByteArray *>(data);
+}
+
+// the reply to a ScreenShot2 call describes the raw data written to the pipe
+
+static QImage imageFromScreenShot2(const QVariantMap &results, const QByteArray &data)
+{
+    if (results.value(QStringLiteral("type")).toString() != QStringLiteral("raw")) {
+        return QImage();
+    }
+
+    const int width = results.value(QStringLiteral("width")).toInt();
+    const int height = results.value(QStringLiteral("height")).toInt();
+    const int stride = results.value(QStringLiteral("stride")).toInt();
+    const uint format = results.value(QStringLiteral("format")).toUInt();
+    if (width <= 0 || height <= 0 || stride <= 0 || format == QImage::Format_Invalid || format >= QImage::NImageFormats
+            || data.size() < static_cast<qint64>(stride) * height) {
+        return QImage();
+    }
+
+    // the image shares the data read from the pipe instead of copying it.
+    // the pipe reader still holds a reference, so the data must only be
+    // read here, data() would detach and copy the whole frame
+
+    QByteArray *pixels = new QByteArray(data);
+    return QImage(reinterpret_cast<const uchar *>(pixels->constData()), width, height, stride,
+                  static_cast<QImage::Format>(format), byteArrayCleanup, pixels);
+}
+
+void X11ImageGrabber::requestKWinWindowImage(xcb_window_t window)
+{
+    // KWin's ScreenShot2 interface writes the pixels to a pipe, so unlike
+    // the pixmap it returns otherwise they don't have to be read back
+    // through the X server
+
+    int pipeFds[2];
+    if (pipe2(pipeFds, O_CLOEXEC) != 0) {
+        grabApplicationWindowHelper(window);
+        return;
+    }
+
+    const QVariantMap options = {
+        {QStringLiteral("include-decoration"), true},
+        {QStringLiteral("include-cursor"), mCapturePointer},
+        {QStringLiteral("native-resolution"), true}
+    };
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(
+        mKWinProxy->screenShot2()->CaptureActiveWindow(options, QDBusUnixFileDescriptor(pipeFds[1])), this);
+    close(pipeFds[1]);
+
+    // the pending call keeps the message it sent, and with it a duplicate
+    // of the write end of the pipe. the pipe only reaches its end once that
+    // is gone, so only the results are kept from the reply
+
+    QSharedPointer<QVariantMap> results(new QVariantMap);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [results](QDBusPendingCallWatcher *pendingCall) {
+        pendingCall->deleteLater();
+        QDBusPendingReply<QVariantMap> reply = *pendingCall;
+        if (reply.isError()) {
+            qCDebug(SPECTACLE_CAPTURE_LOG) << "KWin ScreenShot2 request failed:" << reply.error().message();
+        } else {
+            *results = reply.value();
+        }
+    });
+
+    // the frame of the window is a good guess for the size of the data
+
+    const QRect frameGeometry = mWindowIndex->windowInfo(window).frameGeometry;
+    PipeReader *reader = new PipeReader(pipeFds[0], this);
+    reader->setExpectedSize(static_cast<int>(qMin<qint64>(static_cast<qint64>(frameGeometry.width()) * frameGeometry.height() * 4,
+                                                          256 * 1024 * 1024)));
+    reader->setTimeout(SpectacleConfig::instance()->compositorCaptureTimeout());
+
+    auto finish = [this, reader, results, window](const QByteArray &data) {
+        reader->deleteLater();
+
+        // without a reply the results are empty, which fails the same way
+        // as missing data
+        QImage image;
+        if (!data.isEmpty()) {
+            image = imageFromScreenShot2(*results, data);
+        }
+
+        if (image.isNull()) {
+            mKWinProxy->invalidate(KWinScreenshotProxy::ScreenShot2);
+            grabApplicationWindowHelper(window);
+            return;
+        }
+
+        mImage = image;
+        applyWindowCaptureShadow();
+        emit imageChanged(mImage);
+    };
+    connect(reader, &PipeReader::finished, this, finish);
+    connect(reader, &PipeReader::failed, this, [finish]() {
+        finish(QByteArray());
+    });
+    reader->start();
+}
+
+void X11ImageGrabber::requestKWinScreenshot(const QDBusPendingCall &call, xcb_window_t fallbackWindow)
+{
+    mKWinGrabPending = true;
+
+    // the pixmap arrives with the screenshotCreated signal. if KWin refused
+    // the call, the effect is probably gone, so grab the window ourselves
+
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(call, this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [this, fallbackWindow](QDBusPendingCallWatcher *pendingCall) {
+        pendingCall->deleteLater();
+        if (!pendingCall->isError() || !mKWinGrabPending) {
+            return;
+        }
+
+        qCDebug(SPECTACLE_CAPTURE_LOG) << "KWin screenshot request failed:" << pendingCall->error().message();
+        mKWinGrabPending = false;
+        mKWinProxy->invalidate();
+        grabApplicationWindowHelper(fallbackWindow);
+    });
 }
 
 void X11ImageGrabber::KWinDBusScreenshotHelper(quint64 pixmapId)
 {
+    // the signal is broadcast, so it's also seen when other clients ask KWin
+    // for a screenshot
+
+    if (!mKWinGrabPending) {
+        return;
+    }
+    mKWinGrabPending = false;
+
     // obtain width and height and grab an image (x and y are always zero for pixmaps)
     QRect rect = getDrawableGeometry((xcb_drawable_t)pixmapId);
-    mPixmap = getPixmapFromDrawable((xcb_drawable_t)pixmapId, rect);
-    if (!mPixmap.isNull()) {
-        emit pixmapChanged(mPixmap);
+    mImage = getImageFromDrawable((xcb_drawable_t)pixmapId, rect);
+    if (!mImage.isNull()) {
+        applyWindowCaptureShadow();
+        emit imageChanged(mImage);
         return;
     }
 
@@ -417,14 +1115,14 @@ void X11ImageGrabber::rectangleSelectionCancelled()
     emit imageGrabFailed();
 }
 
-void X11ImageGrabber::rectangleSelectionConfirmed(const QPixmap &pixmap)
+void X11ImageGrabber::rectangleSelectionConfirmed(const QImage &image)
 {
     QObject *sender = QObject::sender();
     sender->disconnect();
     sender->deleteLater();
 
-    mPixmap = pixmap;
-    emit pixmapChanged(mPixmap);
+    mImage = image;
+    emit imageChanged(mImage);
 }
 
 // grabber methods
@@ -437,8 +1135,88 @@ void X11ImageGrabber::updateWindowTitle(xcb_window_t window)
 
 void X11ImageGrabber::grabFullScreen()
 {
-    mPixmap = getToplevelPixmap(QRect(), mCapturePointer);
-    emit pixmapChanged(mPixmap);
+    grabToplevelImageAsync(QRect(), mCapturePointer, [this](const QImage &image) {
+        mImage = image;
+        emit imageChanged(mImage);
+    });
+}
+
+bool X11ImageGrabber::streamGrabSupported() const
+{
+    return true;
+}
+
+bool X11ImageGrabber::doStreamGrab(ImageStreamSink *sink)
+{
+    if (mGrabMode != FullScreen) {
+        return false;
+    }
+
+    QElapsedTimer captureTimer;
+    captureTimer.start();
+
+    xcb_window_t rootWindow = QX11Info::appRootWindow();
+    const QRect rect = getDrawableGeometry(rootWindow);
+    if (!rect.isValid() || !sink->beginImage(rect.size())) {
+        return false;
+    }
+
+    // areas that don't belong to any screen are painted black, just like
+    // in a regular multi-screen grab
+
+    QRegion deadRegion(rect);
+    for (const QRect &screenRect : getNativeScreenRects()) {
+        deadRegion -= screenRect;
+    }
+
+    // the cursor is fetched once and painted onto every band it overlaps
+
+    QImage cursorImage;
+    QRect cursorRect;
+    if (mCapturePointer) {
+        const QPoint cursorPos = getNativeCursorPosition();
+        if (rect.contains(cursorPos)) {
+            QPoint hotspot;
+            cursorImage = getCursorImage(hotspot);
+            cursorRect = QRect(cursorPos - hotspot, cursorImage.size());
+        }
+    }
+
+    // only one band is alive at a time, so memory use doesn't depend on
+    // the size of the desktop
+
+    const int bandHeight = qBound(1, STREAM_BAND_BYTES / (rect.width() * 4), rect.height());
+    for (int y = rect.top(); y <= rect.bottom(); y += bandHeight) {
+        const QRect bandRect(rect.left(), y, rect.width(), qMin(bandHeight, rect.bottom() - y + 1));
+
+        QImage band = getImageFromDrawable(rootWindow, bandRect);
+        if (band.isNull()) {
+            return false;
+        }
+
+        const QRegion bandDeadRegion = deadRegion & bandRect;
+        if (!bandDeadRegion.isEmpty()) {
+            QPainter painter(&band);
+            for (const QRect &deadRect : bandDeadRegion.rects()) {
+                painter.fillRect(deadRect.translated(-bandRect.topLeft()), Qt::black);
+            }
+        }
+        if (cursorRect.intersects(bandRect)) {
+            drawCursorImage(band, cursorRect.topLeft() - bandRect.topLeft(), cursorImage);
+        }
+
+        if (!sink->writeBand(band)) {
+            return false;
+        }
+    }
+
+    if (!sink->finishImage()) {
+        return false;
+    }
+
+    qCDebug(SPECTACLE_CAPTURE_LOG) << "Streamed" << rect << "in bands of" << bandHeight << "rows in"
+                                   << captureTimer.nsecsElapsed() / 1000000.0 << "ms";
+    return true;
 }
 
 void X11ImageGrabber::grabTransientWithParent()
@@ -446,10 +1224,6 @@ void X11ImageGrabber::grabTransientWithParent()
 	xcb_window_t curWin = getRealWindowUnderCursor();
     updateWindowTitle(curWin);
 
-    // grab the image early
-
-    mPixmap = getToplevelPixmap(QRect(), false);
-
     // now that we know we have a transient window, let's
     // find other possible transient windows and the app window itself.
     QRegion clipRegion;
@@ -478,6 +1252,8 @@ void X11ImageGrabber::grabTransientWithParent()
     // All parents are known now, find other transient children.
     // Assume that the lowest window is behind everything else, then if a new
     // transient window is discovered, its children can then also be found.
+    // The window index has the transient relations of all windows at hand,
+    // so this doesn't talk to the X server.
 
     QList<WId> winList = KWindowSystem::stackingOrder();
     for (auto winId : winList) {
@@ -493,45 +1269,55 @@ void X11ImageGrabber::grabTransientWithParent()
         }
     }
 
-    // we can probably go ahead and generate the image now
+    // only the part of the screen covered by the windows is captured. the
+    // window lookups above are served from the window index, so there's
+    // hardly any delay between finding the windows and grabbing them
 
-    QImage tempImage(mPixmap.size(), QImage::Format_ARGB32);
-    tempImage.fill(Qt::transparent);
+    const QRect clipRect = clipRegion.boundingRect();
+    QRegion screenRegion;
+    for (const QRect &screenRect : getNativeScreenRects()) {
+        screenRegion += screenRect;
+    }
+    const QRect captureRect = (screenRegion & clipRect).boundingRect();
+    if (captureRect.isEmpty()) {
+        emit imageGrabFailed();
+        return;
+    }
 
-    QPainter tempPainter(&tempImage);
-    tempPainter.setClipRegion(clipRegion);
-    tempPainter.drawPixmap(0, 0, mPixmap);
-    tempPainter.end();
-    mPixmap = QPixmap::fromImage(tempImage).copy(clipRegion.boundingRect());
+    QImage clusterImage = getToplevelImage(captureRect, false);
+    if (clusterImage.isNull()) {
+        emit imageGrabFailed();
+        return;
+    }
 
-    // why stop here, when we can render a 20px drop shadow all around it
+    // we can probably go ahead and generate the image now. parts of the
+    // windows that are off screen stay transparent
 
-    QGraphicsDropShadowEffect *effect = new QGraphicsDropShadowEffect;
-    effect->setOffset(0);
-    effect->setBlurRadius(20);
+    QImage tempImage(clipRect.size(), QImage::Format_ARGB32_Premultiplied);
+    tempImage.fill(Qt::transparent);
 
-    QGraphicsPixmapItem *item = new QGraphicsPixmapItem;
-    item->setPixmap(mPixmap);
-    item->setGraphicsEffect(effect);
+    QPainter tempPainter(&tempImage);
+    tempPainter.setClipRegion(clipRegion.translated(-clipRect.topLeft()));
+    tempPainter.drawImage(captureRect.topLeft() - clipRect.topLeft(), clusterImage);
+    tempPainter.end();
+    clusterImage = QImage();
 
-    QImage shadowImage(mPixmap.size() + QSize(40, 40), QImage::Format_ARGB32);
-    shadowImage.fill(Qt::transparent);
-    QPainter shadowPainter(&shadowImage);
+    // why stop here, when we can render a drop shadow all around it
 
-    QGraphicsScene scene;
-    scene.addItem(item);
-    scene.render(&shadowPainter, QRectF(), QRectF(-20, -20, mPixmap.width() + 40, mPixmap.height() + 40));
-    shadowPainter.end();
+    const ShadowGenerator shadowGenerator = configuredShadowGenerator();
+    const QMargins shadowMargins = shadowGenerator.margins();
+    QImage shadowImage = shadowGenerator.apply(tempImage);
+    tempImage = QImage();
 
     // we can finish up now
 
-    mPixmap = QPixmap::fromImage(shadowImage);
     if (mCapturePointer) {
-        QPoint topLeft = clipRegion.boundingRect().topLeft() - QPoint(20, 20);
-        mPixmap = blendCursorImage(mPixmap, topLeft.x(), topLeft.y(), mPixmap.width(), mPixmap.height());
+        QPoint topLeft = clipRect.topLeft() - QPoint(shadowMargins.left(), shadowMargins.top());
+        blendCursorImage(shadowImage, topLeft.x(), topLeft.y(), shadowImage.width(), shadowImage.height());
     }
 
-    emit pixmapChanged(mPixmap);
+    mImage = std::move(shadowImage);
+    emit imageChanged(mImage);
 }
 
 void X11ImageGrabber::grabActiveWindow()
@@ -539,23 +1325,21 @@ void X11ImageGrabber::grabActiveWindow()
     xcb_window_t activeWindow = KWindowSystem::activeWindow();
     updateWindowTitle(activeWindow);
 
-    // if KWin is available, use the KWin DBus interfaces
+    // if KWin is available, use the KWin DBus interfaces, preferably the
+    // one that doesn't hand out the image as an X11 pixmap
 
-    if (mCaptureDecorations && isKWinAvailable()) {
-        QDBusConnection bus = QDBusConnection::sessionBus();
-        bus.connect(QStringLiteral("org.kde.KWin"),
-                    QStringLiteral("/Screenshot"),
-                    QStringLiteral("org.kde.kwin.Screenshot"),
-                    QStringLiteral("screenshotCreated"),
-                    this, SLOT(KWinDBusScreenshotHelper(quint64)));
-        QDBusInterface interface(QStringLiteral("org.kde.KWin"), QStringLiteral("/Screenshot"), QStringLiteral("org.kde.kwin.Screenshot"));
+    if (mCaptureDecorations && mKWinProxy->isAvailable(KWinScreenshotProxy::ScreenShot2)) {
+        requestKWinWindowImage(activeWindow);
+        return;
+    }
 
+    if (mCaptureDecorations && isKWinAvailable()) {
         int mask = 1;
         if (mCapturePointer) {
             mask |= 1 << 1;
         }
 
-        interface.call(QStringLiteral("screenshotForWindow"), (quint64)activeWindow, mask);
+        requestKWinScreenshot(mKWinProxy->screenshot()->screenshotForWindow(activeWindow, mask), activeWindow);
         return;
     }
 
@@ -572,20 +1356,12 @@ void X11ImageGrabber::grabWindowUnderCursor()
     // if KWin is available, use the KWin DBus interfaces
 
     if (mCaptureDecorations && isKWinAvailable()) {
-        QDBusConnection bus = QDBusConnection::sessionBus();
-        bus.connect(QStringLiteral("org.kde.KWin"),
-                    QStringLiteral("/Screenshot"),
-                    QStringLiteral("org.kde.kwin.Screenshot"),
-                    QStringLiteral("screenshotCreated"),
-                    this, SLOT(KWinDBusScreenshotHelper(quint64)));
-        QDBusInterface interface(QStringLiteral("org.kde.KWin"), QStringLiteral("/Screenshot"), QStringLiteral("org.kde.kwin.Screenshot"));
-
         int mask = 1;
         if (mCapturePointer) {
             mask |= 1 << 1;
         }
 
-        interface.call(QStringLiteral("screenshotWindowUnderCursor"), mask);
+        requestKWinScreenshot(mKWinProxy->screenshot()->screenshotWindowUnderCursor(mask), windowUnderCursor);
         return;
     }
 
@@ -596,12 +1372,33 @@ void X11ImageGrabber::grabWindowUnderCursor()
 
 void X11ImageGrabber::grabApplicationWindowHelper(xcb_window_t window)
 {
+    // with a compositing manager running, every window keeps its contents
+    // in a pixmap of its own. reading that gets the window right even if
+    // it's covered or partially off screen, and only transfers the window.
+    // kwin doesn't paint the decoration into that pixmap though, so it's
+    // only any good for the client area
+
+    if (!mCaptureDecorations && window != QX11Info::appRootWindow()) {
+        QImage compositeImage = getCompositeWindowImage(window, mCapturePointer);
+        if (!compositeImage.isNull()) {
+            qCDebug(SPECTACLE_CAPTURE_LOG) << "Captured window" << window << "from its composite pixmap";
+            mImage = std::move(compositeImage);
+            applyWindowCaptureShadow();
+            emit imageChanged(mImage);
+            return;
+        }
+    }
+
     // if the user doesn't want decorations captured, we're in luck. This is
     // the easiest bit
 
-    mPixmap = getWindowPixmap(window, mCapturePointer);
     if (!mCaptureDecorations || window == QX11Info::appRootWindow()) {
-        emit pixmapChanged(mPixmap);
+        qCDebug(SPECTACLE_CAPTURE_LOG) << "Capturing window" << window << "without decorations";
+        mImage = getWindowImage(window, mCapturePointer);
+        if (window != QX11Info::appRootWindow()) {
+            applyWindowCaptureShadow();
+        }
+        emit imageChanged(mImage);
         return;
     }
 
@@ -612,19 +1409,192 @@ void X11ImageGrabber::grabApplicationWindowHelper(xcb_window_t window)
     // separate opengl buffer, so grabbing this window is going to simply
     // give us a transparent image with the frame and titlebar.
 
-    // all is not lost. what we need to do is grab the image of the entire
-    // desktop, find the geometry of the window including its frame, and
-    // crop the root image accordingly.
+    // all is not lost. what we need to do is find the geometry of the
+    // window including its frame, and grab that part of the desktop. the
+    // frame geometry is looked up first, so the window is only captured once
 
-    KWindowInfo info(window, NET::WMFrameExtents);
-    if (info.valid()) {
-        QRect frameGeom = info.frameGeometry();
-        mPixmap = getToplevelPixmap(frameGeom, mCapturePointer);
+    const X11WindowIndex::WindowInfo info = mWindowIndex->windowInfo(window);
+    if (info.valid) {
+        qCDebug(SPECTACLE_CAPTURE_LOG) << "Capturing window" << window << "with its frame" << info.frameGeometry << "from the root window";
+        grabToplevelImageAsync(info.frameGeometry, mCapturePointer, [this, window](const QImage &image) {
+            finishApplicationWindowGrab(window, image);
+        });
+        return;
     }
 
+    finishApplicationWindowGrab(window, QImage());
+}
+
+void X11ImageGrabber::finishApplicationWindowGrab(xcb_window_t window, const QImage &frameImage)
+{
     // fallback is window without the frame
 
-    emit pixmapChanged(mPixmap);
+    QImage windowImage = frameImage;
+    if (windowImage.isNull()) {
+        qCDebug(SPECTACLE_CAPTURE_LOG) << "No frame geometry for window" << window << "capturing it without decorations";
+        windowImage = getWindowImage(window, mCapturePointer);
+    }
+
+    mImage = std::move(windowImage);
+    applyWindowCaptureShadow();
+    emit imageChanged(mImage);
+}
+
+QVector<X11ImageGrabber::ToplevelWindow> X11ImageGrabber::getToplevelWindows()
+{
+    xcb_connection_t *xcbConn = QX11Info::connection();
+
+    const QByteArray netWmNameAtomName("_NET_WM_NAME");
+    const QByteArray utf8StringAtomName("UTF8_STRING");
+    xcb_intern_atom_cookie_t netWmNameCookie = xcb_intern_atom_unchecked(xcbConn, 0, netWmNameAtomName.length(), netWmNameAtomName.constData());
+    xcb_intern_atom_cookie_t utf8StringCookie = xcb_intern_atom_unchecked(xcbConn, 0, utf8StringAtomName.length(), utf8StringAtomName.constData());
+    CScopedPointer<xcb_intern_atom_reply_t> netWmNameReply(xcb_intern_atom_reply(xcbConn, netWmNameCookie, nullptr));
+    CScopedPointer<xcb_intern_atom_reply_t> utf8StringReply(xcb_intern_atom_reply(xcbConn, utf8StringCookie, nullptr));
+    ++mRoundTrips;
+    const xcb_atom_t netWmNameAtom = netWmNameReply.isNull() ? XCB_ATOM_NONE : netWmNameReply->atom;
+    const xcb_atom_t utf8StringAtom = utf8StringReply.isNull() ? XCB_ATOM_NONE : utf8StringReply->atom;
+
+    // ask for the map state and the titles of all managed windows at once,
+    // the geometries come from the window index
+
+    struct PendingWindow
+    {
+        xcb_window_t                      window;
+        xcb_get_window_attributes_cookie_t attributesCookie;
+        xcb_get_property_cookie_t         netWmNameCookie;
+        xcb_get_property_cookie_t         wmNameCookie;
+    };
+
+    const QList<WId> stackingOrder = KWindowSystem::stackingOrder();
+    QVector<PendingWindow> pendingWindows;
+    pendingWindows.reserve(stackingOrder.size());
+    for (WId window : stackingOrder) {
+        PendingWindow pending;
+        pending.window = window;
+        pending.attributesCookie = xcb_get_window_attributes_unchecked(xcbConn, window);
+        pending.netWmNameCookie = xcb_get_property_unchecked(xcbConn, 0, window, netWmNameAtom, utf8StringAtom, 0, 1024);
+        pending.wmNameCookie = xcb_get_property_unchecked(xcbConn, 0, window, XCB_ATOM_WM_NAME, XCB_ATOM_STRING, 0, 1024);
+        pendingWindows.append(pending);
+    }
+
+    QVector<ToplevelWindow> windows;
+    for (const PendingWindow &pending : pendingWindows) {
+        CScopedPointer<xcb_get_window_attributes_reply_t> attributesReply(
+            xcb_get_window_attributes_reply(xcbConn, pending.attributesCookie, nullptr));
+        CScopedPointer<xcb_get_property_reply_t> netWmNameReply(xcb_get_property_reply(xcbConn, pending.netWmNameCookie, nullptr));
+        CScopedPointer<xcb_get_property_reply_t> wmNameReply(xcb_get_property_reply(xcbConn, pending.wmNameCookie, nullptr));
+
+        // minimized windows and windows on other desktops aren't viewable
+
+        if (attributesReply.isNull() || attributesReply->map_state != XCB_MAP_STATE_VIEWABLE) {
+            continue;
+        }
+
+        const X11WindowIndex::WindowInfo info = mWindowIndex->windowInfo(pending.window);
+        if (!info.valid) {
+            continue;
+        }
+
+        ToplevelWindow window;
+        window.window = pending.window;
+        window.rect = mCaptureDecorations ? info.frameGeometry : info.geometry;
+        if (!netWmNameReply.isNull() && xcb_get_property_value_length(netWmNameReply.data()) > 0) {
+            window.title = QString::fromUtf8(static_cast<const char *>(xcb_get_property_value(netWmNameReply.data())),
+                                             xcb_get_property_value_length(netWmNameReply.data()));
+        } else if (!wmNameReply.isNull() && xcb_get_property_value_length(wmNameReply.data()) > 0) {
+            window.title = QString::fromLocal8Bit(static_cast<const char *>(xcb_get_property_value(wmNameReply.data())),
+                                                  xcb_get_property_value_length(wmNameReply.data()));
+        }
+        windows.append(window);
+    }
+    ++mRoundTrips;
+
+    return windows;
+}
+
+void X11ImageGrabber::grabAllWindows()
+{
+    const QVector<ToplevelWindow> windows = getToplevelWindows();
+    if (windows.isEmpty()) {
+        emit imageGrabFailed();
+        return;
+    }
+
+    // cropping the windows out of a single grab of the screen takes one
+    // transfer, no matter how many windows there are. but it only gets
+    // windows right that nothing else covers, so reading every window from
+    // its composite pixmap wins unless that's both possible and more
+    // expensive. the composite pixmaps don't have the decorations in them,
+    // so windows with decorations always come from the screen
+
+    QRegion coveredRegion;
+    bool isOverlapping = false;
+    qint64 windowCost = 0;
+    for (const ToplevelWindow &window : windows) {
+        isOverlapping = isOverlapping || coveredRegion.intersects(window.rect);
+        coveredRegion += window.rect;
+        windowCost += qint64(window.rect.width()) * window.rect.height() + WINDOW_REQUEST_COST;
+    }
+
+    QRect screenRect;
+    for (const QRect &nativeScreenRect : getNativeScreenRects()) {
+        screenRect |= nativeScreenRect;
+    }
+    const qint64 screenCost = qint64(screenRect.width()) * screenRect.height();
+    const bool cropFromScreen = mCaptureDecorations || !isCompositeAvailable() || (!isOverlapping && screenCost < windowCost);
+
+    qCDebug(SPECTACLE_CAPTURE_LOG) << "Capturing" << windows.size() << "windows"
+                                   << (cropFromScreen ? "from one grab of the screen" : "from their composite pixmaps");
+
+    QVector<WindowImage> images;
+    if (cropFromScreen) {
+        // the full screen image starts at the origin of the root window, the
+        // windows are views into it rather than copies
+        const QImage screenImage = getToplevelImage(QRect(), mCapturePointer);
+        if (screenImage.isNull()) {
+            emit imageGrabFailed();
+            return;
+        }
+
+        for (const ToplevelWindow &window : windows) {
+            const QRect cropRect = window.rect & screenImage.rect();
+            if (!cropRect.isEmpty()) {
+                images.append({ window.title, ImageViews::crop(screenImage, cropRect) });
+            }
+        }
+    } else {
+        for (const ToplevelWindow &window : windows) {
+            QImage image = getCompositeWindowImage(window.window, mCapturePointer);
+            if (image.isNull()) {
+                image = getWindowImage(window.window, mCapturePointer);
+            }
+            if (!image.isNull()) {
+                images.append({ window.title, image });
+            }
+        }
+    }
+
+    if (images.isEmpty()) {
+        emit imageGrabFailed();
+        return;
+    }
+
+    mImage = QImage();
+    emit windowImagesChanged(images);
+}
+
+ShadowGenerator X11ImageGrabber::configuredShadowGenerator()
+{
+    SpectacleConfig *config = SpectacleConfig::instance();
+    return ShadowGenerator(config->shadowRadius(), config->shadowOffset(), config->shadowColor());
+}
+
+void X11ImageGrabber::applyWindowCaptureShadow()
+{
+    if (mImage.isNull() || !SpectacleConfig::instance()->windowCaptureShadow()) {
+        return;
+    }
+    mImage = configuredShadowGenerator().apply(mImage);
 }
 
 QRect X11ImageGrabber::getDrawableGeometry(xcb_drawable_t drawable)
@@ -633,6 +1603,7 @@ QRect X11ImageGrabber::getDrawableGeometry(xcb_drawable_t drawable)
 
     xcb_get_geometry_cookie_t geomCookie = xcb_get_geometry_unchecked(xcbConn, drawable);
     CScopedPointer<xcb_get_geometry_reply_t> geomReply(xcb_get_geometry_reply(xcbConn, geomCookie, nullptr));
+    ++mRoundTrips;
     if (geomReply.isNull()) {
         return QRect();
     }
@@ -641,35 +1612,44 @@ QRect X11ImageGrabber::getDrawableGeometry(xcb_drawable_t drawable)
 
 void X11ImageGrabber::grabCurrentScreen()
 {
-    QPoint cursorPosition = QCursor::pos();
-    for (auto screen : QGuiApplication::screens()) {
-        QRect screenRect = screen->geometry();
-        if (!screenRect.contains(cursorPosition)) {
-            continue;
+    // an output asked for by name wins over the one below the cursor
+
+    X11ScreenLayout::Output output;
+    if (!mScreenName.isEmpty()) {
+        output = mScreenLayout->output(mScreenName);
+        if (output.name.isEmpty()) {
+            qCWarning(SPECTACLE_CAPTURE_LOG) << "No output named" << mScreenName;
+            emit imageGrabFailed();
+            return;
         }
+    } else {
+        output = mScreenLayout->outputAt(QCursor::pos());
+    }
 
-        // The screen origin is in native pixels, but the size is device-dependent. Convert these also to native pixels.
-        QRect nativeScreenRect(screenRect.topLeft(), screenRect.size() * screen->devicePixelRatio());
-        mPixmap = getToplevelPixmap(nativeScreenRect, mCapturePointer);
-        emit pixmapChanged(mPixmap);
+    if (output.name.isEmpty()) {
+        // No screen found with our cursor, fallback to capturing full screen
+        grabFullScreen();
         return;
     }
 
-    // No screen found with our cursor, fallback to capturing full screen
-    grabFullScreen();
+    grabToplevelImageAsync(output.geometry, mCapturePointer, [this](const QImage &image) {
+        mImage = image;
+        emit imageChanged(mImage);
+    });
 }
 
 void X11ImageGrabber::grabRectangularRegion()
 {
-    const auto pixmap = getToplevelPixmap(QRect(), mCapturePointer);
-    if (!pixmap.isNull()) {
-        QuickEditor *editor = new QuickEditor(pixmap);
-
-        connect(editor, &QuickEditor::grabDone, this, &X11ImageGrabber::rectangleSelectionConfirmed);
-        connect(editor, &QuickEditor::grabCancelled, this, &X11ImageGrabber::rectangleSelectionCancelled);
-    } else {
-        emit pixmapChanged(pixmap);
-    }
+    grabToplevelImageAsync(QRect(), mCapturePointer, [this](const QImage &image) {
+        if (!image.isNull()) {
+            QuickEditor *editor = new QuickEditor(image);
+
+            connect(editor, &QuickEditor::grabDone, this, &X11ImageGrabber::rectangleSelectionConfirmed);
+            connect(editor, &QuickEditor::grabCancelled, this, &X11ImageGrabber::rectangleSelectionCancelled);
+        } else {
+            emit imageChanged(image);
+        }
+    });
 }
 
 xcb_window_t X11ImageGrabber::getRealWindowUnderCursor()
@@ -682,40 +1662,96 @@ xcb_window_t X11ImageGrabber::getRealWindowUnderCursor()
     xcb_query_pointer_cookie_t pointerCookie = xcb_query_pointer_unchecked(xcbConn, curWin);
     CScopedPointer<xcb_intern_atom_reply_t> atomReply(xcb_intern_atom_reply(xcbConn, atomCookie, nullptr));
     CScopedPointer<xcb_query_pointer_reply_t> pointerReply(xcb_query_pointer_reply(xcbConn, pointerCookie, nullptr));
+    ++mRoundTrips;
 
     if (atomReply->atom == XCB_ATOM_NONE) {
         return QX11Info::appRootWindow();
     }
 
-    // now start testing
+    // now start testing. we are looking for the first window with the
+    // WM_STATE property set in a depth-first walk of the tree below the
+    // pointer. to avoid two round trips per window, the tree is walked one
+    // level at a time, with the requests for all windows of a level sent
+    // before waiting for any reply. every window remembers its path from
+    // the top, so that among the matches we can pick the one the depth-first
+    // walk would have found first: the one with the smallest path
+
+    struct Candidate
+    {
+        xcb_window_t window;
+        QVector<int> path;
+    };
+
+    QVector<Candidate> level;
+    if (pointerReply->child != XCB_WINDOW_NONE) {
+        level.append({ pointerReply->child, QVector<int>() });
+    }
 
-    QStack<xcb_window_t> windowStack;
-    windowStack.push(pointerReply->child);
+    xcb_window_t foundWin = XCB_WINDOW_NONE;
+    QVector<int> foundPath;
 
-    while (!windowStack.isEmpty()) {
-        curWin = windowStack.pop();
+    while (!level.isEmpty()) {
+        QVector<xcb_get_property_cookie_t> propertyCookies;
+        QVector<xcb_query_tree_cookie_t> treeCookies;
+        for (const Candidate &candidate : level) {
+            propertyCookies.append(xcb_get_property_unchecked(xcbConn, 0, candidate.window, atomReply->atom, XCB_ATOM_ANY, 0, 0));
+            treeCookies.append(xcb_query_tree_unchecked(xcbConn, candidate.window));
+        }
+        ++mRoundTrips;
 
-        // next, check if our window has the WM_STATE property set on
-        // the window. if yes, return the window - we have found it
+        QVector<Candidate> nextLevel;
+        for (int i = 0; i < level.size(); ++i) {
+            const Candidate &candidate = level.at(i);
 
-        xcb_get_property_cookie_t propertyCookie = xcb_get_property_unchecked(xcbConn, 0, curWin, atomReply->atom, XCB_ATOM_ANY, 0, 0);
-        CScopedPointer<xcb_get_property_reply_t> propertyReply(xcb_get_property_reply(xcbConn, propertyCookie, nullptr));
+            // replies are collected even if we don't need them, otherwise
+            // they'd pile up in the connection
 
-        if (propertyReply->type != XCB_ATOM_NONE) {
-            return curWin;
-        }
+            CScopedPointer<xcb_get_property_reply_t> propertyReply(xcb_get_property_reply(xcbConn, propertyCookies.at(i), nullptr));
+            CScopedPointer<xcb_query_tree_reply_t> treeReply(xcb_query_tree_reply(xcbConn, treeCookies.at(i), nullptr));
 
-        // if we're here, this means the window is not the real window
-        // we should start looking at its children
+            // next, check if our window has the WM_STATE property set on
+            // the window. if yes, its children don't matter anymore
 
-        xcb_query_tree_cookie_t treeCookie = xcb_query_tree_unchecked(xcbConn, curWin);
-        CScopedPointer<xcb_query_tree_reply_t> treeReply(xcb_query_tree_reply(xcbConn, treeCookie, nullptr));
-        xcb_window_t *winChildren = xcb_query_tree_children(treeReply.data());
-        int winChildrenLength = xcb_query_tree_children_length(treeReply.data());
+            if (!propertyReply.isNull() && propertyReply->type != XCB_ATOM_NONE) {
+                if (foundWin == XCB_WINDOW_NONE || candidate.path < foundPath) {
+                    foundWin = candidate.window;
+                    foundPath = candidate.path;
+                }
+                continue;
+            }
 
-        for (int i = winChildrenLength - 1; i >= 0; i--) {
-            windowStack.push(winChildren[i]);
+            // if we're here, this means the window is not the real window
+            // we should start looking at its children
+
+            if (treeReply.isNull()) {
+                continue;
+            }
+
+            xcb_window_t *winChildren = xcb_query_tree_children(treeReply.data());
+            int winChildrenLength = xcb_query_tree_children_length(treeReply.data());
+
+            for (int j = 0; j < winChildrenLength; j++) {
+                QVector<int> childPath = candidate.path;
+                childPath.append(j);
+                nextLevel.append({ winChildren[j], childPath });
+            }
         }
+
+        // only windows that the depth-first walk would have visited before
+        // the best match so far are still worth looking at
+
+        if (foundWin != XCB_WINDOW_NONE) {
+            auto it = std::remove_if(nextLevel.begin(), nextLevel.end(), [&foundPath](const Candidate &candidate) {
+                return !(candidate.path < foundPath);
+            });
+            nextLevel.erase(it, nextLevel.end());
+        }
+
+        level = nextLevel;
+    }
+
+    if (foundWin != XCB_WINDOW_NONE) {
+        return foundWin;
     }
 
     // return the window. it has geometry information for a crop
@@ -727,16 +1763,15 @@ xcb_window_t X11ImageGrabber::getRealWindowUnderCursor()
 // obtain the size of the given window, returning the window ID of the parent
 xcb_window_t X11ImageGrabber::getTransientWindowParent(xcb_window_t winId, QRect &outRect)
 {
-    NET::Properties properties = mCaptureDecorations ? NET::WMFrameExtents : NET::WMGeometry;
-    KWindowInfo winInfo(winId, properties, NET::WM2TransientFor);
+    const X11WindowIndex::WindowInfo winInfo = mWindowIndex->windowInfo(winId);
 
     // add the current window to the image
     if (mCaptureDecorations) {
-        outRect = winInfo.frameGeometry();
+        outRect = winInfo.frameGeometry;
     } else {
-        outRect = winInfo.geometry();
+        outRect = winInfo.geometry;
     }
-    return winInfo.transientFor();
+    return winInfo.transientFor;
 }
 
 QPoint X11ImageGrabber::getNativeCursorPosition()
@@ -748,15 +1783,16 @@ QPoint X11ImageGrabber::getNativeCursorPosition()
     xcb_connection_t *xcbConn = QX11Info::connection();
     xcb_query_pointer_cookie_t pointerCookie = xcb_query_pointer_unchecked(xcbConn, QX11Info::appRootWindow());
     CScopedPointer<xcb_query_pointer_reply_t> pointerReply(xcb_query_pointer_reply(xcbConn, pointerCookie, nullptr));
+    ++mRoundTrips;
 
     return QPoint(pointerReply->root_x, pointerReply->root_y);
 }
 
 QVector<ImageGrabber::GrabMode> X11ImageGrabber::supportedModes() const
 {
-    if (QApplication::screens().count() == 1) {
-        return {FullScreen, ActiveWindow, WindowUnderCursor, TransientWithParent, RectangularRegion};
+    if (mScreenLayout->outputs().count() == 1) {
+        return {FullScreen, ActiveWindow, WindowUnderCursor, TransientWithParent, RectangularRegion, AllWindows};
     }
 
-    return {FullScreen, CurrentScreen, ActiveWindow, WindowUnderCursor, TransientWithParent, RectangularRegion};
+    return {FullScreen, CurrentScreen, ActiveWindow, WindowUnderCursor, TransientWithParent, RectangularRegion, AllWindows};
 }
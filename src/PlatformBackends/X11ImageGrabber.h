@@ -21,12 +21,23 @@
 #define X11IMAGEGRABBER_H
 
 #include <QAbstractNativeEventFilter>
+#include <QMutex>
+#include <QVector>
+
+#include <functional>
 
 #include <xcb/xcb.h>
 #include <xcb/xcb_image.h>
 
 #include "ImageGrabber.h"
-
+#include "X11ImageReader.h"
+#include "X11WindowIndex.h"
+#include "X11CursorCache.h"
+#include "X11ScreenLayout.h"
+#include "KWinScreenshotProxy.h"
+#include "ImageProcessing/ShadowGenerator.h"
+
+class QDBusPendingCall;
 class X11ImageGrabber;
 
 class OnClickEventFilter : public QAbstractNativeEventFilter
@@ -52,6 +63,8 @@ class X11ImageGrabber : public ImageGrabber
 
     QVector<ImageGrabber::GrabMode> supportedModes() const override;
     bool onClickGrabSupported() const override;
+    bool streamGrabSupported() const override;
+    bool doStreamGrab(ImageStreamSink *sink) override;
 
     protected:
 
@@ -61,33 +74,68 @@ class X11ImageGrabber : public ImageGrabber
     void grabRectangularRegion()   override;
     void grabWindowUnderCursor()   override;
     void grabTransientWithParent() override;
-    QPixmap blendCursorImage(const QPixmap &pixmap, int x, int y, int width, int height) override;
+    void grabAllWindows()          override;
+    void blendCursorImage(QImage &image, int x, int y, int width, int height) override;
 
     private Q_SLOTS:
 
     void KWinDBusScreenshotHelper(quint64 window);
-    void rectangleSelectionConfirmed(const QPixmap &pixmap);
+    void rectangleSelectionConfirmed(const QImage &image);
     void rectangleSelectionCancelled();
 
     public Q_SLOTS:
 
+    void doImageGrab() override;
     void doOnClickGrab() override;
 
     private:
 
+    struct ToplevelWindow
+    {
+        xcb_window_t window;
+        QString      title;
+        QRect        rect;   // with or without the frame, as configured
+    };
+
     bool                 isKWinAvailable();
+    void                 requestKWinScreenshot(const QDBusPendingCall &call, xcb_window_t fallbackWindow);
+    void                 requestKWinWindowImage(xcb_window_t window);
     xcb_window_t         getRealWindowUnderCursor();
     void                 grabApplicationWindowHelper(xcb_window_t window);
+    void                 finishApplicationWindowGrab(xcb_window_t window, const QImage &frameImage);
+    QVector<ToplevelWindow> getToplevelWindows();
     QRect                getDrawableGeometry(xcb_drawable_t drawable);
-    QPixmap              postProcessPixmap(const QPixmap &pixmap, QRect rect, bool blendPointer);
-    QPixmap              getPixmapFromDrawable(xcb_drawable_t drawableId, const QRect &rect);
-    QPixmap              getToplevelPixmap(QRect rect, bool blendPointer);
-    QPixmap              getWindowPixmap(xcb_window_t window, bool blendPointer);
-    QPixmap              convertFromNative(xcb_image_t *xcbImage);
+    QImage               postProcessImage(QImage image, QRect rect, bool blendPointer);
+    QImage               getImageFromDrawable(xcb_drawable_t drawableId, const QRect &rect);
+    QRect                planToplevelGrab(QRect rect, QVector<QRect> &tiles);
+    QImage               getToplevelImage(QRect rect, bool blendPointer);
+    void                 grabToplevelImageAsync(QRect rect, bool blendPointer, const std::function<void (const QImage &)> &done);
+    QVector<QRect>       getNativeScreenRects();
+    QImage               getTiledImage(xcb_window_t rootWindow, const QRect &rect, const QVector<QRect> &tiles);
+    QVector<X11ImageReader *> acquireReaders(int count);
+    void                 releaseReaders(const QVector<X11ImageReader *> &readers);
+    QImage               getWindowImage(xcb_window_t window, bool blendPointer);
+    bool                 isCompositeAvailable();
+    QImage               getCompositeWindowImage(xcb_window_t window, bool blendPointer);
+    static QImage        convertFromNative(xcb_image_t *xcbImage, bool isShared);
     xcb_window_t         getTransientWindowParent(xcb_window_t winId, QRect &outRect);
     QPoint               getNativeCursorPosition();
+    QImage               getCursorImage(QPoint &hotspot);
+    static ShadowGenerator configuredShadowGenerator();
+    void                 applyWindowCaptureShadow();
 
     OnClickEventFilter          *mNativeEventFilter;
+    X11ImageReader              *mImageReader;
+    X11WindowIndex              *mWindowIndex;
+    X11CursorCache              *mCursorCache;
+    X11ScreenLayout             *mScreenLayout;
+    KWinScreenshotProxy         *mKWinProxy;
+    bool                         mKWinGrabPending;
+    QMutex                       mReaderPoolMutex;
+    QVector<X11ImageReader *>    mIdleReaders;
+    int                          mRoundTrips;
+    bool                         mCompositeChecked;
+    bool                         mCompositeAvailable;
     void updateWindowTitle(xcb_window_t window);
 };
 
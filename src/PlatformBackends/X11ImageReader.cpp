@@ -0,0 +1,252 @@
+/*
+ *  Copyright (C) 2019 The Spectacle Developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "X11ImageReader.h"
+#include "spectacle_capture_debug.h"
+
+#include <QScopedPointer>
+
+#include <cstdlib>
+
+#ifdef XCB_SHM_FOUND
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#endif
+
+// segments are allocated in steps of 4 MiB so that slightly larger grabs
+// don't force us to throw away and re-attach the segment every time
+
+static const size_t SEGMENT_GRANULARITY = 4 * 1024 * 1024;
+
+X11ImageReader::X11ImageReader() :
+    X11ImageReader(xcb_connect(nullptr, nullptr))
+{
+    mOwnsConnection = true;
+}
+
+X11ImageReader::X11ImageReader(xcb_connection_t *connection) :
+    mConnection(connection),
+    mOwnsConnection(false),
+    mShmAvailable(false)
+#ifdef XCB_SHM_FOUND
+    ,
+    mSegment(XCB_NONE),
+    mSegmentId(-1),
+    mSegmentData(nullptr),
+    mSegmentSize(0)
+#endif
+{
+    if (isConnected()) {
+        initShm();
+    }
+}
+
+X11ImageReader::~X11ImageReader()
+{
+    releaseSegment();
+    if (mOwnsConnection) {
+        xcb_disconnect(mConnection);
+    }
+}
+
+void X11ImageReader::initShm()
+{
+#ifdef XCB_SHM_FOUND
+    const xcb_query_extension_reply_t *extension = xcb_get_extension_data(mConnection, &xcb_shm_id);
+    if (extension && extension->present) {
+        xcb_shm_query_version_cookie_t versionCookie = xcb_shm_query_version_unchecked(mConnection);
+        QScopedPointer<xcb_shm_query_version_reply_t, QScopedPointerPodDeleter> versionReply(
+            xcb_shm_query_version_reply(mConnection, versionCookie, nullptr));
+        mShmAvailable = !versionReply.isNull();
+    }
+#endif
+    qCDebug(SPECTACLE_CAPTURE_LOG) << "MIT-SHM capture path available:" << mShmAvailable;
+}
+
+xcb_connection_t *X11ImageReader::connection() const
+{
+    return mConnection;
+}
+
+bool X11ImageReader::isConnected() const
+{
+    // xcb_connect() never returns null, a failed connection is flagged instead
+    return !xcb_connection_has_error(mConnection);
+}
+
+bool X11ImageReader::isShmAvailable() const
+{
+    return mShmAvailable;
+}
+
+xcb_image_t *X11ImageReader::getImage(xcb_drawable_t drawable, const QRect &rect, bool *isShared)
+{
+    if (isShared) {
+        *isShared = false;
+    }
+
+    if (mShmAvailable) {
+        xcb_image_t *xcbImage = getImageShm(drawable, rect);
+        if (xcbImage) {
+            if (isShared) {
+                *isShared = true;
+            }
+            return xcbImage;
+        }
+    }
+
+    return xcb_image_get(
+        mConnection,
+        drawable,
+        rect.x(),
+        rect.y(),
+        rect.width(),
+        rect.height(),
+        ~0,
+        XCB_IMAGE_FORMAT_Z_PIXMAP
+    );
+}
+
+xcb_image_t *X11ImageReader::getImageShm(xcb_drawable_t drawable, const QRect &rect)
+{
+#ifdef XCB_SHM_FOUND
+    // none of the depths we can convert use more than 32 bits per pixel, and
+    // 32-bit scanlines never need any padding
+
+    const size_t maxSize = static_cast<size_t>(rect.width()) * static_cast<size_t>(rect.height()) * 4;
+    if (!ensureSegment(maxSize)) {
+        return nullptr;
+    }
+
+    xcb_shm_get_image_cookie_t imageCookie = xcb_shm_get_image_unchecked(
+        mConnection,
+        drawable,
+        rect.x(),
+        rect.y(),
+        rect.width(),
+        rect.height(),
+        ~0,
+        XCB_IMAGE_FORMAT_Z_PIXMAP,
+        mSegment,
+        0
+    );
+
+    xcb_generic_error_t *error = nullptr;
+    QScopedPointer<xcb_shm_get_image_reply_t, QScopedPointerPodDeleter> imageReply(
+        xcb_shm_get_image_reply(mConnection, imageCookie, &error));
+    if (error) {
+        free(error);
+        return nullptr;
+    }
+    if (imageReply.isNull()) {
+        return nullptr;
+    }
+
+    // wrap the segment in an xcb_image_t. as the base pointer is null, the
+    // image doesn't take ownership of the data and xcb_image_destroy() will
+    // leave the segment alone
+
+    return xcb_image_create_native(
+        mConnection,
+        rect.width(),
+        rect.height(),
+        XCB_IMAGE_FORMAT_Z_PIXMAP,
+        imageReply->depth,
+        nullptr,
+        imageReply->size,
+        mSegmentData
+    );
+#else
+    Q_UNUSED(drawable);
+    Q_UNUSED(rect);
+    return nullptr;
+#endif
+}
+
+bool X11ImageReader::ensureSegment(size_t size)
+{
+#ifdef XCB_SHM_FOUND
+    if (mSegmentData && mSegmentSize >= size) {
+        return true;
+    }
+
+    releaseSegment();
+
+    size = ((size + SEGMENT_GRANULARITY - 1) / SEGMENT_GRANULARITY) * SEGMENT_GRANULARITY;
+    mSegmentId = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+    if (mSegmentId < 0) {
+        qCWarning(SPECTACLE_CAPTURE_LOG) << "Failed to allocate a shared memory segment, disabling MIT-SHM";
+        mShmAvailable = false;
+        return false;
+    }
+
+    void *data = shmat(mSegmentId, nullptr, 0);
+    if (data == reinterpret_cast<void *>(-1)) {
+        shmctl(mSegmentId, IPC_RMID, nullptr);
+        mSegmentId = -1;
+        mShmAvailable = false;
+        return false;
+    }
+
+    // attaching fails if the X server can't see our memory, e.g. because
+    // we're talking to it over the network. don't try again in that case
+
+    mSegment = xcb_generate_id(mConnection);
+    xcb_void_cookie_t attachCookie = xcb_shm_attach_checked(mConnection, mSegment, mSegmentId, 0);
+    xcb_generic_error_t *error = xcb_request_check(mConnection, attachCookie);
+
+    // the segment is destroyed as soon as both we and the server detach from it
+    shmctl(mSegmentId, IPC_RMID, nullptr);
+
+    if (error) {
+        free(error);
+        shmdt(data);
+        mSegment = XCB_NONE;
+        mSegmentId = -1;
+        mShmAvailable = false;
+        qCDebug(SPECTACLE_CAPTURE_LOG) << "The X server refused to attach the shared memory segment, disabling MIT-SHM";
+        return false;
+    }
+
+    mSegmentData = static_cast<quint8 *>(data);
+    mSegmentSize = size;
+    return true;
+#else
+    Q_UNUSED(size);
+    return false;
+#endif
+}
+
+void X11ImageReader::releaseSegment()
+{
+#ifdef XCB_SHM_FOUND
+    if (!mSegmentData) {
+        return;
+    }
+
+    xcb_shm_detach(mConnection, mSegment);
+    xcb_flush(mConnection);
+    shmdt(mSegmentData);
+
+    mSegment = XCB_NONE;
+    mSegmentId = -1;
+    mSegmentData = nullptr;
+    mSegmentSize = 0;
+#endif
+}
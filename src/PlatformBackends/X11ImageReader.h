@@ -0,0 +1,82 @@
+/*
+ *  Copyright (C) 2019 The Spectacle Developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#ifndef X11IMAGEREADER_H
+#define X11IMAGEREADER_H
+
+#include <QRect>
+
+#include <xcb/xcb.h>
+#include <xcb/xcb_image.h>
+
+#include "Config.h"
+
+#ifdef XCB_SHM_FOUND
+#include <xcb/shm.h>
+#endif
+
+// Reads the contents of a drawable from the X server. If the MIT-SHM
+// extension is usable on the connection, the pixels are transferred through
+// a shared memory segment that is kept around and reused for the following
+// reads, otherwise we fall back to a plain GetImage request which pushes
+// every pixel through the X socket.
+//
+// A reader created without a connection opens its own connection to the
+// display, so that it can be used from a worker thread without contending
+// with the GUI thread for the application's connection.
+
+class X11ImageReader
+{
+    public:
+
+    X11ImageReader();
+    explicit X11ImageReader(xcb_connection_t *connection);
+    ~X11ImageReader();
+
+    X11ImageReader(X11ImageReader const&) = delete;
+    void operator= (X11ImageReader const&) = delete;
+
+    xcb_connection_t *connection() const;
+    bool isConnected() const;
+    bool isShmAvailable() const;
+
+    // The returned image must be freed with xcb_image_destroy(). If the
+    // image was read through the shared memory segment, its data is owned
+    // by the segment and is only valid until the next call to getImage().
+    xcb_image_t *getImage(xcb_drawable_t drawable, const QRect &rect, bool *isShared = nullptr);
+
+    private:
+
+    void initShm();
+    xcb_image_t *getImageShm(xcb_drawable_t drawable, const QRect &rect);
+    bool ensureSegment(size_t size);
+    void releaseSegment();
+
+    xcb_connection_t *mConnection;
+    bool              mOwnsConnection;
+    bool              mShmAvailable;
+#ifdef XCB_SHM_FOUND
+    xcb_shm_seg_t     mSegment;
+    int               mSegmentId;
+    quint8           *mSegmentData;
+    size_t            mSegmentSize;
+#endif
+};
+
+#endif // X11IMAGEREADER_H
@@ -0,0 +1,175 @@
+/*
+ *  Copyright (C) 2019 The Spectacle Developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "X11ScreenLayout.h"
+#include "spectacle_capture_debug.h"
+#include "Config.h"
+
+#include <QGuiApplication>
+#include <QScreen>
+#include <QtMath>
+
+#ifdef XCB_RANDR_FOUND
+#include <xcb/randr.h>
+#endif
+
+X11ScreenLayout::X11ScreenLayout(xcb_connection_t *connection, xcb_window_t rootWindow, QObject *parent) :
+    QObject(parent),
+    QAbstractNativeEventFilter(),
+    mRandrFirstEvent(0),
+    mRandrTracking(false),
+    mValid(false)
+{
+#ifdef XCB_RANDR_FOUND
+    // the xcb platform plugin selects the same RandR events on the root
+    // window. the selection is per connection, so it must not be narrowed
+
+    const xcb_query_extension_reply_t *extension = xcb_get_extension_data(connection, &xcb_randr_id);
+    if (extension && extension->present) {
+        mRandrFirstEvent = extension->first_event;
+        xcb_randr_select_input(connection, rootWindow,
+                               XCB_RANDR_NOTIFY_MASK_SCREEN_CHANGE | XCB_RANDR_NOTIFY_MASK_OUTPUT_CHANGE
+                               | XCB_RANDR_NOTIFY_MASK_CRTC_CHANGE | XCB_RANDR_NOTIFY_MASK_OUTPUT_PROPERTY);
+        mRandrTracking = true;
+        qApp->installNativeEventFilter(this);
+    }
+#else
+    Q_UNUSED(connection);
+    Q_UNUSED(rootWindow);
+#endif
+
+    // Qt updates its screens from the same notifications, but only after
+    // we've seen them, so the layout is rebuilt from the screens later on
+
+    connect(qApp, &QGuiApplication::screenAdded, this, &X11ScreenLayout::invalidate);
+    connect(qApp, &QGuiApplication::screenRemoved, this, &X11ScreenLayout::invalidate);
+}
+
+X11ScreenLayout::~X11ScreenLayout()
+{
+    if (mRandrTracking) {
+        qApp->removeNativeEventFilter(this);
+    }
+}
+
+QVector<X11ScreenLayout::Output> X11ScreenLayout::outputs()
+{
+    rebuild();
+    return mOutputs;
+}
+
+QVector<QRect> X11ScreenLayout::nativeRects()
+{
+    rebuild();
+    return mNativeRects;
+}
+
+QRect X11ScreenLayout::nativeBoundingRect()
+{
+    rebuild();
+    return mNativeBoundingRect;
+}
+
+X11ScreenLayout::Output X11ScreenLayout::outputAt(const QPoint &logicalPos)
+{
+    rebuild();
+    for (const Output &output : mOutputs) {
+        if (output.logicalGeometry.contains(logicalPos)) {
+            return output;
+        }
+    }
+    return Output();
+}
+
+X11ScreenLayout::Output X11ScreenLayout::output(const QString &name)
+{
+    rebuild();
+    for (const Output &output : mOutputs) {
+        if (output.name == name) {
+            return output;
+        }
+    }
+    return Output();
+}
+
+void X11ScreenLayout::invalidate()
+{
+    if (mValid) {
+        mValid = false;
+        emit layoutChanged();
+    }
+}
+
+void X11ScreenLayout::rebuild()
+{
+    if (mValid) {
+        return;
+    }
+
+    mOutputs.clear();
+    mNativeRects.clear();
+    mNativeBoundingRect = QRect();
+
+    const QList<QScreen *> screens = QGuiApplication::screens();
+    for (QScreen *screen : screens) {
+        Output output;
+        output.name = screen->name();
+        output.logicalGeometry = screen->geometry();
+        output.scale = screen->devicePixelRatio();
+
+        // the origin is in native pixels already, only the size is scaled.
+        // do not use QSize::operator*=() here, it performs qRound() which
+        // can result in xcb_image_get() failing
+        output.geometry = QRect(output.logicalGeometry.topLeft(),
+                                QSize(qFloor(output.logicalGeometry.width() * output.scale),
+                                      qFloor(output.logicalGeometry.height() * output.scale)));
+
+        mOutputs.append(output);
+        mNativeRects.append(output.geometry);
+        mNativeBoundingRect |= output.geometry;
+
+        connect(screen, &QScreen::geometryChanged, this, &X11ScreenLayout::invalidate, Qt::UniqueConnection);
+    }
+
+    mValid = true;
+    qCDebug(SPECTACLE_CAPTURE_LOG) << "Screen layout updated," << mOutputs.size() << "outputs in" << mNativeBoundingRect;
+}
+
+bool X11ScreenLayout::nativeEventFilter(const QByteArray &eventType, void *message, long *result)
+{
+    Q_UNUSED(result);
+
+#ifdef XCB_RANDR_FOUND
+    if (eventType != "xcb_generic_event_t") {
+        return false;
+    }
+
+    xcb_generic_event_t *event = static_cast<xcb_generic_event_t *>(message);
+    const int responseType = event->response_type & ~0x80;
+    if (responseType == mRandrFirstEvent + XCB_RANDR_SCREEN_CHANGE_NOTIFY
+            || responseType == mRandrFirstEvent + XCB_RANDR_NOTIFY) {
+        invalidate();
+    }
+#else
+    Q_UNUSED(eventType);
+    Q_UNUSED(message);
+#endif
+
+    return false;
+}
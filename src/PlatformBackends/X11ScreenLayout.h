@@ -0,0 +1,85 @@
+/*
+ *  Copyright (C) 2019 The Spectacle Developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#ifndef X11SCREENLAYOUT_H
+#define X11SCREENLAYOUT_H
+
+#include <QAbstractNativeEventFilter>
+#include <QObject>
+#include <QRect>
+#include <QString>
+#include <QVector>
+
+#include <xcb/xcb.h>
+
+// The geometry of all outputs, in native pixels as the X server sees them
+// and in the logical coordinates Qt uses, worked out once per layout.
+//
+// The layout is rebuilt lazily the first time it's used after RandR told us
+// the outputs changed, or after Qt added, removed or moved a screen. Every
+// capture in between only looks the geometry up.
+
+class X11ScreenLayout : public QObject, public QAbstractNativeEventFilter
+{
+    Q_OBJECT
+
+    public:
+
+    struct Output
+    {
+        QString name;
+        QRect   geometry;         // native pixels
+        QRect   logicalGeometry;  // device independent pixels, like QScreen::geometry()
+        qreal   scale = 1.0;
+    };
+
+    explicit X11ScreenLayout(xcb_connection_t *connection, xcb_window_t rootWindow, QObject *parent = nullptr);
+    ~X11ScreenLayout() override;
+
+    QVector<Output> outputs();
+    QVector<QRect> nativeRects();
+    QRect nativeBoundingRect();
+
+    // return an invalid output (with an empty name) if there is none
+    Output outputAt(const QPoint &logicalPos);
+    Output output(const QString &name);
+
+    bool nativeEventFilter(const QByteArray &eventType, void *message, long *result) override;
+
+    Q_SIGNALS:
+
+    void layoutChanged();
+
+    private Q_SLOTS:
+
+    void invalidate();
+
+    private:
+
+    void rebuild();
+
+    quint8           mRandrFirstEvent;
+    bool             mRandrTracking;
+    bool             mValid;
+    QVector<Output>  mOutputs;
+    QVector<QRect>   mNativeRects;
+    QRect            mNativeBoundingRect;
+};
+
+#endif // X11SCREENLAYOUT_H
@@ -0,0 +1,237 @@
+/*
+ *  Copyright (C) 2019 The Spectacle Developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "X11WindowIndex.h"
+#include "spectacle_capture_debug.h"
+
+#include <KWindowSystem>
+
+#include <QGuiApplication>
+#include <QScopedPointer>
+#include <QWindow>
+
+X11WindowIndex::X11WindowIndex(xcb_connection_t *connection, xcb_window_t rootWindow, QObject *parent) :
+    QObject(parent),
+    QAbstractNativeEventFilter(),
+    mConnection(connection),
+    mRootWindow(rootWindow),
+    mFrameExtentsAtom(XCB_ATOM_NONE),
+    mPopulated(false)
+{
+    qApp->installNativeEventFilter(this);
+
+    connect(KWindowSystem::self(), &KWindowSystem::windowAdded, this, &X11WindowIndex::windowAdded);
+    connect(KWindowSystem::self(), &KWindowSystem::windowRemoved, this, &X11WindowIndex::windowRemoved);
+}
+
+X11WindowIndex::~X11WindowIndex()
+{
+    qApp->removeNativeEventFilter(this);
+}
+
+X11WindowIndex::WindowInfo X11WindowIndex::windowInfo(xcb_window_t window)
+{
+    populate();
+
+    // windows the window manager doesn't know about, like popup menus, are
+    // added to the index the first time somebody asks for them
+
+    if (!mWindows.contains(window)) {
+        mWindows.insert(window, WindowInfo());
+        mDirtyWindows.insert(window);
+    }
+
+    refresh();
+    return mWindows.value(window);
+}
+
+void X11WindowIndex::populate()
+{
+    if (mPopulated) {
+        return;
+    }
+
+    const QByteArray atomName("_NET_FRAME_EXTENTS");
+    xcb_intern_atom_cookie_t atomCookie = xcb_intern_atom_unchecked(mConnection, 0, atomName.length(), atomName.constData());
+    QScopedPointer<xcb_intern_atom_reply_t, QScopedPointerPodDeleter> atomReply(
+        xcb_intern_atom_reply(mConnection, atomCookie, nullptr));
+    if (!atomReply.isNull()) {
+        mFrameExtentsAtom = atomReply->atom;
+    }
+
+    const QList<WId> windows = KWindowSystem::windows();
+    for (WId window : windows) {
+        mWindows.insert(window, WindowInfo());
+        mDirtyWindows.insert(window);
+    }
+    mPopulated = true;
+}
+
+void X11WindowIndex::refresh()
+{
+    if (mDirtyWindows.isEmpty()) {
+        return;
+    }
+
+    // send the requests for all windows before waiting for the first reply
+
+    struct PendingWindow
+    {
+        xcb_window_t                       window;
+        xcb_get_property_cookie_t          transientCookie;
+        xcb_get_property_cookie_t          frameExtentsCookie;
+        xcb_get_geometry_cookie_t          geometryCookie;
+        xcb_translate_coordinates_cookie_t translateCookie;
+    };
+
+    const QSet<xcb_window_t> dirtyWindows = mDirtyWindows;
+    mDirtyWindows.clear();
+
+    QVector<PendingWindow> pendingWindows;
+    pendingWindows.reserve(dirtyWindows.size());
+
+    for (xcb_window_t window : dirtyWindows) {
+        if (!mWindows.value(window).valid) {
+            watchWindow(window);
+        }
+
+        PendingWindow pending;
+        pending.window = window;
+        pending.transientCookie = xcb_get_property_unchecked(mConnection, 0, window, XCB_ATOM_WM_TRANSIENT_FOR, XCB_ATOM_WINDOW, 0, 1);
+        pending.frameExtentsCookie = xcb_get_property_unchecked(mConnection, 0, window, mFrameExtentsAtom, XCB_ATOM_CARDINAL, 0, 4);
+        pending.geometryCookie = xcb_get_geometry_unchecked(mConnection, window);
+        pending.translateCookie = xcb_translate_coordinates_unchecked(mConnection, window, mRootWindow, 0, 0);
+        pendingWindows.append(pending);
+    }
+
+    for (const PendingWindow &pending : pendingWindows) {
+        QScopedPointer<xcb_get_property_reply_t, QScopedPointerPodDeleter> transientReply(
+            xcb_get_property_reply(mConnection, pending.transientCookie, nullptr));
+        QScopedPointer<xcb_get_property_reply_t, QScopedPointerPodDeleter> frameExtentsReply(
+            xcb_get_property_reply(mConnection, pending.frameExtentsCookie, nullptr));
+        QScopedPointer<xcb_get_geometry_reply_t, QScopedPointerPodDeleter> geometryReply(
+            xcb_get_geometry_reply(mConnection, pending.geometryCookie, nullptr));
+        QScopedPointer<xcb_translate_coordinates_reply_t, QScopedPointerPodDeleter> translateReply(
+            xcb_translate_coordinates_reply(mConnection, pending.translateCookie, nullptr));
+
+        // the window is gone
+
+        if (geometryReply.isNull() || translateReply.isNull()) {
+            mWindows.remove(pending.window);
+            continue;
+        }
+
+        WindowInfo info;
+        info.valid = true;
+        info.geometry = QRect(translateReply->dst_x, translateReply->dst_y, geometryReply->width, geometryReply->height);
+
+        if (!transientReply.isNull() && transientReply->type == XCB_ATOM_WINDOW && transientReply->format == 32
+                && xcb_get_property_value_length(transientReply.data()) >= 4) {
+            info.transientFor = *static_cast<xcb_window_t *>(xcb_get_property_value(transientReply.data()));
+        }
+
+        // _NET_FRAME_EXTENTS is left, right, top, bottom
+
+        info.frameGeometry = info.geometry;
+        if (!frameExtentsReply.isNull() && frameExtentsReply->type == XCB_ATOM_CARDINAL && frameExtentsReply->format == 32
+                && xcb_get_property_value_length(frameExtentsReply.data()) >= 16) {
+            const quint32 *extents = static_cast<quint32 *>(xcb_get_property_value(frameExtentsReply.data()));
+            info.frameGeometry.adjust(-static_cast<int>(extents[0]), -static_cast<int>(extents[2]),
+                                      static_cast<int>(extents[1]), static_cast<int>(extents[3]));
+        }
+
+        mWindows.insert(pending.window, info);
+    }
+
+    qCDebug(SPECTACLE_CAPTURE_LOG) << "Window index refreshed" << pendingWindows.size() << "windows";
+}
+
+void X11WindowIndex::watchWindow(xcb_window_t window)
+{
+    // the event mask is per connection and window, and our own windows
+    // need the one Qt has selected. for all other windows this is the same
+    // mask KWindowSystem selects when it tracks them
+
+    for (QWindow *ownWindow : QGuiApplication::topLevelWindows()) {
+        if (ownWindow->handle() && ownWindow->winId() == window) {
+            return;
+        }
+    }
+
+    const uint32_t eventMask = XCB_EVENT_MASK_PROPERTY_CHANGE | XCB_EVENT_MASK_STRUCTURE_NOTIFY;
+    xcb_change_window_attributes(mConnection, window, XCB_CW_EVENT_MASK, &eventMask);
+}
+
+bool X11WindowIndex::nativeEventFilter(const QByteArray &eventType, void *message, long *result)
+{
+    Q_UNUSED(result);
+
+    if (eventType != "xcb_generic_event_t") {
+        return false;
+    }
+
+    xcb_generic_event_t *event = static_cast<xcb_generic_event_t *>(message);
+
+    // only mark windows as out of date here, they are fetched again in a
+    // batch the next time the index is used. the events are never consumed
+
+    switch (event->response_type & ~0x80) {
+    case XCB_PROPERTY_NOTIFY: {
+        xcb_property_notify_event_t *propertyEvent = reinterpret_cast<xcb_property_notify_event_t *>(event);
+        if ((propertyEvent->atom == XCB_ATOM_WM_TRANSIENT_FOR || propertyEvent->atom == mFrameExtentsAtom)
+                && mWindows.contains(propertyEvent->window)) {
+            mDirtyWindows.insert(propertyEvent->window);
+        }
+        break;
+    }
+    case XCB_CONFIGURE_NOTIFY: {
+        // window managers send synthetic ConfigureNotify events to clients
+        // when their frame moves, so this covers moves as well as resizes
+        xcb_configure_notify_event_t *configureEvent = reinterpret_cast<xcb_configure_notify_event_t *>(event);
+        if (mWindows.contains(configureEvent->window)) {
+            mDirtyWindows.insert(configureEvent->window);
+        }
+        break;
+    }
+    case XCB_DESTROY_NOTIFY: {
+        xcb_destroy_notify_event_t *destroyEvent = reinterpret_cast<xcb_destroy_notify_event_t *>(event);
+        mWindows.remove(destroyEvent->window);
+        mDirtyWindows.remove(destroyEvent->window);
+        break;
+    }
+    default:
+        break;
+    }
+
+    return false;
+}
+
+void X11WindowIndex::windowAdded(WId window)
+{
+    if (mPopulated) {
+        mWindows.insert(window, WindowInfo());
+        mDirtyWindows.insert(window);
+    }
+}
+
+void X11WindowIndex::windowRemoved(WId window)
+{
+    mWindows.remove(window);
+    mDirtyWindows.remove(window);
+}
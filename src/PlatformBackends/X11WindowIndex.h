@@ -0,0 +1,82 @@
+/*
+ *  Copyright (C) 2019 The Spectacle Developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#ifndef X11WINDOWINDEX_H
+#define X11WINDOWINDEX_H
+
+#include <QAbstractNativeEventFilter>
+#include <QHash>
+#include <QObject>
+#include <QRect>
+#include <QSet>
+#include <QVector>
+#include <QWindowDefs>
+
+#include <xcb/xcb.h>
+
+// An in-memory index of the transient-for relation and the geometry of
+// the windows on the screen.
+//
+// Everything the index knows is fetched in batches: all windows that are
+// unknown or out of date are queried with a single round trip the next time
+// the index is asked about any window. After that, PropertyNotify and
+// ConfigureNotify events mark windows as out of date, so looking a window up
+// normally doesn't involve the X server at all.
+
+class X11WindowIndex : public QObject, public QAbstractNativeEventFilter
+{
+    Q_OBJECT
+
+    public:
+
+    struct WindowInfo
+    {
+        bool         valid = false;
+        xcb_window_t transientFor = XCB_WINDOW_NONE;
+        QRect        geometry;       // client area, in root window coordinates
+        QRect        frameGeometry;  // geometry including the window manager frame
+    };
+
+    explicit X11WindowIndex(xcb_connection_t *connection, xcb_window_t rootWindow, QObject *parent = nullptr);
+    ~X11WindowIndex() override;
+
+    WindowInfo windowInfo(xcb_window_t window);
+    void refresh();
+
+    bool nativeEventFilter(const QByteArray &eventType, void *message, long *result) override;
+
+    private Q_SLOTS:
+
+    void windowAdded(WId window);
+    void windowRemoved(WId window);
+
+    private:
+
+    void populate();
+    void watchWindow(xcb_window_t window);
+
+    xcb_connection_t                  *mConnection;
+    xcb_window_t                       mRootWindow;
+    xcb_atom_t                         mFrameExtentsAtom;
+    bool                               mPopulated;
+    QHash<xcb_window_t, WindowInfo>    mWindows;
+    QSet<xcb_window_t>                 mDirtyWindows;
+};
+
+#endif // X11WINDOWINDEX_H
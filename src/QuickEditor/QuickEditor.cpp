@@ -22,6 +22,7 @@
 
 #include "QuickEditor.h"
 #include "SpectacleConfig.h"
+#include "ImageProcessing/ImageViews.h"
 
 const qreal QuickEditor::mouseAreaSize = 20.0;
 const qreal QuickEditor::cornerHandleRadius = 8.0;
@@ -45,7 +46,7 @@ const int QuickEditor::magZoom = 5;
 const int QuickEditor::magPixels = 16;
 const int QuickEditor::magOffset = 32;
 
-QuickEditor::QuickEditor(const QPixmap& pixmap) :
+QuickEditor::QuickEditor(const QImage& image) :
     mMaskColor(QColor::fromRgbF(0, 0, 0, 0.15)),
     mStrokeColor(palette().highlight().color()),
     mCrossColor(QColor::fromRgbF(mStrokeColor.redF(), mStrokeColor.greenF(), mStrokeColor.blueF(), 0.7)),
@@ -74,7 +75,8 @@ QuickEditor::QuickEditor(const QPixmap& pixmap) :
     mBottomHelpTextFont(font()),
     mBottomHelpGridLeftWidth(0),
     mMouseDragState(MouseState::None),
-    mPixmap(pixmap),
+    mImage(image),
+    mPixmap(QPixmap::fromImage(image)),
     mMagnifierAllowed(false),
     mShowMagnifier(SpectacleConfig::instance()->showMagnifierChecked()),
     mToggleMagnifier(false)
@@ -137,7 +139,7 @@ void QuickEditor::acceptSelection()
             qRound(mSelection.height() * dpr)
         );
         SpectacleConfig::instance()->setCropRegion(scaledCropRegion);
-        emit grabDone(mPixmap.copy(scaledCropRegion));
+        emit grabDone(ImageViews::crop(mImage, scaledCropRegion));
     }
 }
 
@@ -21,6 +21,7 @@
 #ifndef QUICKEDITOR_H
 #define QUICKEDITOR_H
 
+#include <QImage>
 #include <QKeyEvent>
 #include <QPainter>
 #include <QStaticText>
@@ -35,7 +36,7 @@ class QuickEditor : public QWidget
     Q_OBJECT
 
 public:
-    explicit QuickEditor(const QPixmap &pixmap);
+    explicit QuickEditor(const QImage &image);
 
 private:
     enum MouseState : short {
@@ -116,7 +117,8 @@ private:
     QPoint mBottomHelpContentPos;
     int mBottomHelpGridLeftWidth;
     MouseState mMouseDragState;
-    QPixmap mPixmap;
+    QImage mImage;      // what the selection is cut from
+    QPixmap mPixmap;    // what's painted
     qreal dprI;
     QPointF mMousePos;
     bool mMagnifierAllowed;
@@ -124,7 +126,7 @@ private:
     bool mToggleMagnifier;
 
 Q_SIGNALS:
-    void grabDone(const QPixmap &pixmap);
+    void grabDone(const QImage &image);
     void grabCancelled();
 };
 
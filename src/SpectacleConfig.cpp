@@ -315,3 +315,144 @@ void SpectacleConfig::setSaveImageFormat(const QString &saveFmt)
     mGeneralConfig.writeEntry(QStringLiteral("default-save-image-format"), saveFmt);
     mGeneralConfig.sync();
 }
+
+// grab the X server while capturing multiple screens
+
+bool SpectacleConfig::grabServerDuringCapture() const
+{
+    return mGeneralConfig.readEntry(QStringLiteral("grabServerDuringCapture"), false);
+}
+
+void SpectacleConfig::setGrabServerDuringCapture(bool enabled)
+{
+    mGeneralConfig.writeEntry(QStringLiteral("grabServerDuringCapture"), enabled);
+    mGeneralConfig.sync();
+}
+
+// how long to wait for the compositor to send a screenshot, including the
+// time it takes to click a window in interactive mode. zero waits forever
+
+int SpectacleConfig::compositorCaptureTimeout() const
+{
+    return mGeneralConfig.readEntry(QStringLiteral("compositorCaptureTimeout"), 30000);
+}
+
+void SpectacleConfig::setCompositorCaptureTimeout(int msec)
+{
+    mGeneralConfig.writeEntry(QStringLiteral("compositorCaptureTimeout"), msec);
+    mGeneralConfig.sync();
+}
+
+// drop shadow of transient window captures
+
+int SpectacleConfig::shadowRadius() const
+{
+    return mGuiConfig.readEntry(QStringLiteral("shadowRadius"), 20);
+}
+
+void SpectacleConfig::setShadowRadius(int radius)
+{
+    mGuiConfig.writeEntry(QStringLiteral("shadowRadius"), radius);
+    mGuiConfig.sync();
+}
+
+QPoint SpectacleConfig::shadowOffset() const
+{
+    return mGuiConfig.readEntry(QStringLiteral("shadowOffset"), QPoint());
+}
+
+void SpectacleConfig::setShadowOffset(const QPoint &offset)
+{
+    mGuiConfig.writeEntry(QStringLiteral("shadowOffset"), offset);
+    mGuiConfig.sync();
+}
+
+// the colour is stored as #AARRGGBB, reading QColor entries directly would
+// need KConfigGui
+
+QColor SpectacleConfig::shadowColor() const
+{
+    const QColor color(mGuiConfig.readEntry(QStringLiteral("shadowColor"), QString()));
+    return color.isValid() ? color : QColor(63, 63, 63, 180);
+}
+
+void SpectacleConfig::setShadowColor(const QColor &color)
+{
+    mGuiConfig.writeEntry(QStringLiteral("shadowColor"), color.name(QColor::HexArgb));
+    mGuiConfig.sync();
+}
+
+// drop shadow of window captures
+
+bool SpectacleConfig::windowCaptureShadow() const
+{
+    return mGuiConfig.readEntry(QStringLiteral("windowCaptureShadow"), false);
+}
+
+void SpectacleConfig::setWindowCaptureShadow(bool enabled)
+{
+    mGuiConfig.writeEntry(QStringLiteral("windowCaptureShadow"), enabled);
+    mGuiConfig.sync();
+}
+
+// encoding profiles
+
+static KConfigGroup encodingGroup(const KSharedConfigPtr &config, EncodingProfile profile)
+{
+    return KConfigGroup(config, profile == EncodingProfile::Fast ? "FastEncoding" : "ArchivalEncoding");
+}
+
+EncodingSettings SpectacleConfig::encodingSettings(EncodingProfile profile) const
+{
+    const KConfigGroup group = encodingGroup(mConfig, profile);
+    const bool isFast = (profile == EncodingProfile::Fast);
+
+    EncodingSettings settings;
+    settings.compression = qBound(0, group.readEntry(QStringLiteral("compression"), isFast ? 1 : 9), 9);
+    settings.quality = qBound(-1, group.readEntry(QStringLiteral("quality"), isFast ? 85 : 95), 100);
+    settings.optimized = group.readEntry(QStringLiteral("optimized"), !isFast);
+    settings.progressive = group.readEntry(QStringLiteral("progressive"), !isFast);
+    return settings;
+}
+
+void SpectacleConfig::setEncodingSettings(EncodingProfile profile, const EncodingSettings &settings)
+{
+    KConfigGroup group = encodingGroup(mConfig, profile);
+    group.writeEntry(QStringLiteral("compression"), settings.compression);
+    group.writeEntry(QStringLiteral("quality"), settings.quality);
+    group.writeEntry(QStringLiteral("optimized"), settings.optimized);
+    group.writeEntry(QStringLiteral("progressive"), settings.progressive);
+    group.sync();
+}
+
+EncodingProfile SpectacleConfig::saveEncodingProfile() const
+{
+    switch (mGeneralConfig.readEntry(QStringLiteral("saveEncodingProfile"), 1)) {
+        case 0:
+            return EncodingProfile::Fast;
+        default:
+            return EncodingProfile::Archival;
+    }
+}
+
+void SpectacleConfig::setSaveEncodingProfile(EncodingProfile profile)
+{
+    mGeneralConfig.writeEntry(QStringLiteral("saveEncodingProfile"), static_cast<int>(profile));
+    mGeneralConfig.sync();
+}
+
+EncodingProfile SpectacleConfig::tempEncodingProfile() const
+{
+    switch (mGeneralConfig.readEntry(QStringLiteral("tempEncodingProfile"), 0)) {
+        case 1:
+            return EncodingProfile::Archival;
+        default:
+            return EncodingProfile::Fast;
+    }
+}
+
+void SpectacleConfig::setTempEncodingProfile(EncodingProfile profile)
+{
+    mGeneralConfig.writeEntry(QStringLiteral("tempEncodingProfile"), static_cast<int>(profile));
+    mGeneralConfig.sync();
+}
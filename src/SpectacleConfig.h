@@ -23,6 +23,8 @@
 #include <QObject>
 #include <QUrl>
 #include <QRect>
+#include <QPoint>
+#include <QColor>
 
 #include <KSharedConfig>
 #include <KConfigGroup>
@@ -32,6 +34,22 @@ enum class SaveMode {
     Save
 };
 
+// how much effort goes into encoding a saved image. files that are only
+// handed to other applications, like the ones for drag and drop, are better
+// written fast, screenshots that are kept are better written small
+
+enum class EncodingProfile {
+    Fast,
+    Archival
+};
+
+struct EncodingSettings {
+    int  compression;   // 0 (fastest) to 9 (smallest), for PNG
+    int  quality;       // 0 to 100 for lossy formats like JPEG and WebP, -1 for the plugin default
+    bool optimized;     // spend more time for a smaller file, for JPEG
+    bool progressive;   // progressive scans, for JPEG
+};
+
 class SpectacleConfig : public QObject
 {
     Q_OBJECT
@@ -117,6 +135,33 @@ class SpectacleConfig : public QObject
     QString saveImageFormat() const;
     void setSaveImageFormat(const QString &saveFmt);
 
+    bool grabServerDuringCapture() const;
+    void setGrabServerDuringCapture(bool enabled);
+
+    int compositorCaptureTimeout() const;
+    void setCompositorCaptureTimeout(int msec);
+
+    int shadowRadius() const;
+    void setShadowRadius(int radius);
+
+    QPoint shadowOffset() const;
+    void setShadowOffset(const QPoint &offset);
+
+    QColor shadowColor() const;
+    void setShadowColor(const QColor &color);
+
+    bool windowCaptureShadow() const;
+    void setWindowCaptureShadow(bool enabled);
+
+    EncodingSettings encodingSettings(EncodingProfile profile) const;
+    void setEncodingSettings(EncodingProfile profile, const EncodingSettings &settings);
+
+    EncodingProfile saveEncodingProfile() const;
+    void setSaveEncodingProfile(EncodingProfile profile);
+
+    EncodingProfile tempEncodingProfile() const;
+    void setTempEncodingProfile(EncodingProfile profile);
+
     private:
 
     KSharedConfigPtr mConfig;
@@ -37,11 +37,13 @@
 #include <QDebug>
 #include <QDir>
 #include <QDrag>
+#include <QPixmap>
 #include <QMimeData>
 #include <QTimer>
 
 SpectacleCore::SpectacleCore(StartMode startMode, ImageGrabber::GrabMode grabMode, QString &saveFileName,
-               qint64 delayMsec, bool notifyOnGrab, QObject *parent) :
+               qint64 delayMsec, bool notifyOnGrab, bool streamGrab,
+               const QString &screenName, QObject *parent) :
     QObject(parent),
     mExportManager(ExportManager::instance()),
     mStartMode(startMode),
@@ -79,6 +81,7 @@ SpectacleCore::SpectacleCore(StartMode startMode, ImageGrabber::GrabMode grabMod
     setGrabMode(grabMode);
     mImageGrabber->setCapturePointer(guiConfig.readEntry("includePointer", true));
     mImageGrabber->setCaptureDecorations(guiConfig.readEntry("includeDecorations", true));
+    mImageGrabber->setScreenName(screenName);
 
     if ((!(mImageGrabber->onClickGrabSupported())) && (delayMsec < 0)) {
         delayMsec = 0;
@@ -92,7 +95,8 @@ SpectacleCore::SpectacleCore(StartMode startMode, ImageGrabber::GrabMode grabMod
 
     connect(mExportManager, &ExportManager::errorMessage, this, &SpectacleCore::showErrorMessage);
     connect(this, &SpectacleCore::errorMessage, this, &SpectacleCore::showErrorMessage);
-    connect(mImageGrabber, &ImageGrabber::pixmapChanged, this, &SpectacleCore::screenshotUpdated);
+    connect(mImageGrabber, &ImageGrabber::imageChanged, this, &SpectacleCore::screenshotUpdated);
+    connect(mImageGrabber, &ImageGrabber::windowImagesChanged, this, &SpectacleCore::windowScreenshotsUpdated);
     connect(mImageGrabber, &ImageGrabber::windowTitleChanged, mExportManager, &ExportManager::setWindowTitle);
     connect(mImageGrabber, &ImageGrabber::imageGrabFailed, this, &SpectacleCore::screenshotFailed);
     connect(mExportManager, &ExportManager::imageSaved, this, &SpectacleCore::doCopyPath);
@@ -104,6 +108,18 @@ SpectacleCore::SpectacleCore(StartMode startMode, ImageGrabber::GrabMode grabMod
         break;
     case BackgroundMode: {
             int msec = (KWindowSystem::compositingActive() ? 200 : 50) + delayMsec;
+
+            // streaming encodes the screenshot while it is captured, so that
+            // huge desktops never have to be held in memory as a whole
+            if (streamGrab) {
+                if (mImageGrabber->streamGrabSupported() && grabMode == ImageGrabber::FullScreen
+                        && delayMsec >= 0 && mExportManager->isStreamSaveSupported(mFileNameUrl)) {
+                    QTimer::singleShot(msec, this, &SpectacleCore::doStreamGrab);
+                    break;
+                }
+                qCWarning(SPECTACLE_CORE_LOG) << "Streaming is only supported for full screen PNG screenshots saved to a local file, taking a regular screenshot";
+            }
+
             QTimer::singleShot(msec, mImageGrabber, &ImageGrabber::doImageGrab);
         }
         break;
@@ -187,10 +203,10 @@ void SpectacleCore::showErrorMessage(const QString &errString)
     }
 }
 
-void SpectacleCore::screenshotUpdated(const QPixmap &pixmap)
+void SpectacleCore::screenshotUpdated(const QImage &image)
 {
-    mExportManager->setPixmap(pixmap);
-    mExportManager->updatePixmapTimestamp();
+    mExportManager->setImage(image);
+    mExportManager->updateImageTimestamp();
 
     switch (mStartMode) {
     case BackgroundMode:
@@ -203,20 +219,82 @@ void SpectacleCore::screenshotUpdated(const QPixmap &pixmap)
 
             QUrl savePath = (mStartMode == BackgroundMode && mFileNameUrl.isValid() && mFileNameUrl.isLocalFile()) ?
                     mFileNameUrl : QUrl();
-            mExportManager->doSave(savePath);
-
-            // if we notify, we emit allDone only if the user either dismissed the notification or pressed
-            // the "Open" button, otherwise the app closes before it can react to it.
-            if (!mNotify) {
+            savePath = mExportManager->doSave(savePath);
+            if (!savePath.isValid()) {
                 emit allDone();
+                break;
             }
+
+            // the image is saved in the background, so we're only done once it's on disk. if we
+            // notify, we emit allDone only if the user either dismissed the notification or pressed
+            // the "Open" button, otherwise the app closes before it can react to it.
+            mExportManager->onSaveFinished(savePath, this, [this](bool success) {
+                if (!success || !mNotify) {
+                    emit allDone();
+                }
+            });
         }
         break;
     case GuiMode:
-        mMainWindow->setScreenshotAndShow(pixmap);
+        mMainWindow->setScreenshotAndShow(image);
     }
 }
 
+void SpectacleCore::windowScreenshotsUpdated(const QVector<ImageGrabber::WindowImage> &images)
+{
+    mExportManager->updateImageTimestamp();
+
+    // the window images are saved right away in every mode, there's no
+    // way to show more than one screenshot in the GUI
+
+    if (mNotify && mStartMode != GuiMode) {
+        connect(mExportManager, &ExportManager::imageSaved, this, &SpectacleCore::doNotify);
+    }
+
+    QUrl savePath = (mStartMode == BackgroundMode && mFileNameUrl.isValid() && mFileNameUrl.isLocalFile()) ?
+            mFileNameUrl : QUrl();
+    savePath = mExportManager->doSaveWindowImages(images, savePath);
+    if (mStartMode == GuiMode) {
+        return;
+    }
+    if (!savePath.isValid()) {
+        emit allDone();
+        return;
+    }
+
+    mExportManager->onSaveFinished(savePath, this, [this](bool success) {
+        if (!success || !mNotify) {
+            emit allDone();
+        }
+    });
+}
+
+void SpectacleCore::doStreamGrab()
+{
+    mExportManager->updateImageTimestamp();
+
+    if (mNotify) {
+        connect(mExportManager, &ExportManager::imageSaved, this, &SpectacleCore::doNotify);
+    }
+
+    // a stream grab is synchronous and only used in background mode, the
+    // file is written in the background. on failure the export manager has
+    // already reported the error
+
+    QUrl savePath = (mFileNameUrl.isValid() && mFileNameUrl.isLocalFile()) ? mFileNameUrl : QUrl();
+    savePath = mExportManager->doStreamSave(mImageGrabber, savePath);
+    if (!savePath.isValid()) {
+        emit allDone();
+        return;
+    }
+
+    mExportManager->onSaveFinished(savePath, this, [this](bool success) {
+        if (!success || !mNotify) {
+            emit allDone();
+        }
+    });
+}
+
 void SpectacleCore::screenshotFailed()
 {
     switch (mStartMode) {
@@ -255,6 +333,9 @@ void SpectacleCore::doNotify(const QUrl &savedAt)
     case ImageGrabber::GrabMode::RectangularRegion:
         notify->setTitle(i18nc("A rectangular region was captured, heading", "Rectangular Region Captured"));
         break;
+    case ImageGrabber::GrabMode::AllWindows:
+        notify->setTitle(i18nc("Every window was captured into its own image, heading", "All Windows Captured"));
+        break;
     case ImageGrabber::GrabMode::InvalidChoice:
     default:
         break;
@@ -263,7 +344,9 @@ void SpectacleCore::doNotify(const QUrl &savedAt)
     const QString &path = savedAt.adjusted(QUrl::RemoveFilename | QUrl::StripTrailingSlash).path();
 
     // a speaking message is prettier than a URL, special case for the default pictures location
-    if (path == QStandardPaths::writableLocation(QStandardPaths::PicturesLocation)) {
+    if (mImageGrabber->grabMode() == ImageGrabber::GrabMode::AllWindows) {
+        notify->setText(i18nc("Placeholder is a folder", "The screenshots of all windows were saved to '%1'.", savedAt.toLocalFile()));
+    } else if (path == QStandardPaths::writableLocation(QStandardPaths::PicturesLocation)) {
         notify->setText(i18nc("Placeholder is filename", "A screenshot was saved as '%1' to your Pictures folder.", savedAt.fileName()));
     } else {
         notify->setText(i18n("A screenshot was saved as '%1' to '%2'.", savedAt.fileName(), path));
@@ -301,7 +384,7 @@ void SpectacleCore::doStartDragAndDrop()
 
     QDrag *dragHandler = new QDrag(this);
     dragHandler->setMimeData(mimeData);
-    dragHandler->setPixmap(mExportManager->pixmap().scaled(256, 256, Qt::KeepAspectRatioByExpanding, Qt::SmoothTransformation));
+    dragHandler->setPixmap(QPixmap::fromImage(mExportManager->image().scaled(256, 256, Qt::KeepAspectRatioByExpanding, Qt::SmoothTransformation)));
     dragHandler->exec(Qt::CopyAction);
 }
 
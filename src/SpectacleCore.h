@@ -42,7 +42,8 @@ class SpectacleCore : public QObject
     };
 
     explicit SpectacleCore(StartMode startMode, ImageGrabber::GrabMode grabMode, QString &saveFileName,
-                    qint64 delayMsec, bool notifyOnGrab, QObject *parent = nullptr);
+                    qint64 delayMsec, bool notifyOnGrab, bool streamGrab = false,
+                    const QString &screenName = QString(), QObject *parent = nullptr);
     ~SpectacleCore();
 
     QString filename() const;
@@ -62,13 +63,18 @@ class SpectacleCore : public QObject
 
     void takeNewScreenshot(const ImageGrabber::GrabMode &mode, const int &timeout, const bool &includePointer, const bool &includeDecorations);
     void showErrorMessage(const QString &errString);
-    void screenshotUpdated(const QPixmap &pixmap);
+    void screenshotUpdated(const QImage &image);
+    void windowScreenshotsUpdated(const QVector<ImageGrabber::WindowImage> &images);
     void screenshotFailed();
     void dbusStartAgent();
     void doStartDragAndDrop();
     void doNotify(const QUrl &savedAt);
     void doCopyPath(const QUrl &savedAt);
 
+    private Q_SLOTS:
+
+    void doStreamGrab();
+
     private:
 
     void initGui();
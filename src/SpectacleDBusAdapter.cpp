@@ -62,3 +62,8 @@ Q_NOREPLY void SpectacleDBusAdapter::RectangularRegion(bool includeMousePointer)
 {
     parent()->takeNewScreenshot(ImageGrabber::RectangularRegion, 0, includeMousePointer, false);
 }
+
+Q_NOREPLY void SpectacleDBusAdapter::AllWindows(bool includeWindowDecorations, bool includeMousePointer)
+{
+    parent()->takeNewScreenshot(ImageGrabber::AllWindows, 0, includeMousePointer, includeWindowDecorations);
+}
@@ -48,6 +48,10 @@ class SpectacleDBusAdapter: public QDBusAbstractAdaptor
         "    <method name=\"RectangularRegion\">\n"
         "      <arg direction=\"in\" type=\"b\" name=\"includeMousePointer\"/>\n"
         "    </method>\n"
+        "    <method name=\"AllWindows\">\n"
+        "      <arg direction=\"in\" type=\"b\" name=\"includeWindowDecorations\"/>\n"
+        "      <arg direction=\"in\" type=\"b\" name=\"includeMousePointer\"/>\n"
+        "    </method>\n"
         "    <signal name=\"ScreenshotTaken\">\n"
         "      <arg direction=\"out\" type=\"s\" name=\"fileName\"/>\n"
         "    </signal>\n"
@@ -72,6 +76,7 @@ class SpectacleDBusAdapter: public QDBusAbstractAdaptor
     Q_NOREPLY void ActiveWindow(bool includeWindowDecorations, bool includeMousePointer);
     Q_NOREPLY void WindowUnderCursor(bool includeWindowDecorations, bool includeMousePointer);
     Q_NOREPLY void RectangularRegion(bool includeMousePointer);
+    Q_NOREPLY void AllWindows(bool includeWindowDecorations, bool includeMousePointer);
 
     Q_SIGNALS:
 